@@ -0,0 +1,60 @@
+// Adaptive sample counts for ssdo.fs and indirect.fs. With adaptive set the
+// kernel loop stops at the end of any batch of adaptiveBatch samples once the
+// standard error of the per-sample visibility mean is below adaptiveTolerance.
+// With adaptiveTiles set as well, tiles that classify.cs marked flat stop
+// after the first batch. Batches stride through the kernel, since the random
+// kernel grows its radius with the index and a leading batch would only see
+// the nearest samples.
+
+// the statistics below are side effects, keep the stencil mask ahead of them
+layout (early_fragment_tests) in;
+
+uniform int adaptive;
+uniform int adaptiveTiles;
+uniform usampler2D textureTiles;
+
+// with collectStats set, every shaded pixel adds its sample count to
+// statSamples[statSlot] and one to statPixels[statSlot]
+uniform int collectStats;
+layout (std430, binding = 4) buffer AdaptiveStats
+{
+    uint statSamples[2];
+    uint statPixels[2];
+};
+
+const int adaptiveBatch = 8;
+const float adaptiveTolerance = 0.05;
+const int classifyTileSize = 8;
+
+int adaptiveCap(int count)
+{
+    if (adaptive == 1 && adaptiveTiles == 1 &&
+        texelFetch(textureTiles, ivec2(gl_FragCoord.xy) / classifyTileSize, 0).r == 0u)
+        return min(count, adaptiveBatch);
+    return count;
+}
+// Kernel index of the n-th sample of count: batch n / adaptiveBatch takes
+// every (count / adaptiveBatch)-th sample, starting at the batch number.
+int adaptiveIndex(int n, int count)
+{
+    if (adaptive == 0 || count <= adaptiveBatch || count % adaptiveBatch != 0)
+        return n;
+    int stride = count / adaptiveBatch;
+    return (n % adaptiveBatch) * stride + n / adaptiveBatch;
+}
+bool adaptiveDone(int taken, float sum, float sumSq)
+{
+    if (adaptive == 0 || taken % adaptiveBatch != 0)
+        return false;
+    float mean = sum / float(taken);
+    float variance = max(sumSq / float(taken) - mean * mean, 0.0);
+    return sqrt(variance / float(taken)) <= adaptiveTolerance;
+}
+void recordSamples(int statSlot, int taken)
+{
+    if (collectStats == 1)
+    {
+        atomicAdd(statSamples[statSlot], uint(taken));
+        atomicAdd(statPixels[statSlot], 1u);
+    }
+}
@@ -4,19 +4,54 @@ in vec2 texCoord;
 
 out vec4 fragColor;
 
-uniform sampler2D textureSSAO;
+#include "gbuffer.glsl"
+
+uniform sampler2D textureSource;
+
+// (1, 0) for the horizontal pass, (0, 1) for the vertical pass
+uniform vec2 direction;
+uniform int radius;
+// blur the shadow term stored in the G-buffer instead of textureSource
+uniform int shadowMask;
+
+const float depthSigma = 0.05;
+const float normalPower = 16.0;
+
+vec4 readSource(vec2 uv)
+{
+    return shadowMask == 1 ? vec4(readShadow(uv)) : texture(textureSource, uv);
+}
 
 void main()
 {
-    vec2 texelSize = 1.0 / vec2(textureSize(textureSSAO, 0));
+    vec4 center = readPosition(texCoord);
+    if (center.w == 0.0)
+    {
+        fragColor = readSource(texCoord);
+        return;
+    }
+    vec3 normal = readNormal(texCoord);
+
+    vec2 texelStep = direction / vec2(textureSize(textureDepth, 0));
+    float sigma = max(float(radius) * 0.5, 1.0);
     vec4 result = vec4(0.0);
-    for (int x = -3; x < 3; ++x)
+    float weightSum = 0.0;
+    for (int i = -radius; i <= radius; ++i)
     {
-        for (int y = -3; y < 3; ++y)
-        {
-            vec2 offset = vec2(float(x), float(y)) * texelSize;
-            result += texture(textureSSAO, texCoord + offset);
-        }
+        vec2 uv = texCoord + float(i) * texelStep;
+        vec4 samplePos = readPosition(uv);
+        if (samplePos.w == 0.0)
+            continue;
+        vec3 sampleNormal = readNormal(uv);
+
+        // relative depth difference, so the tolerance scales with distance
+        float dz = (samplePos.z - center.z) / max(abs(center.z), 1e-3);
+        float w = exp(-float(i * i) / (2.0 * sigma * sigma));
+        w *= exp(-dz * dz / (2.0 * depthSigma * depthSigma));
+        w *= pow(max(dot(normal, sampleNormal), 0.0), normalPower);
+
+        result += readSource(uv) * w;
+        weightSum += w;
     }
-    fragColor = result / (7.0 * 7.0);
-}
\ No newline at end of file
+    fragColor = weightSum > 0.0 ? result / weightSum : readSource(texCoord);
+}
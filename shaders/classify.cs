@@ -0,0 +1,68 @@
+# version 450 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r8ui, binding = 0) uniform writeonly uimage2D imageTiles;
+
+#include "gbuffer.glsl"
+
+// a tile is complex when its relative depth range or the extent of its
+// normals exceeds these
+const float depthThreshold = 0.02;
+const float normalThreshold = 0.3;
+
+// positive floats keep their order as uint bits, so shared atomics can
+// reduce them
+shared uint minDepth;
+shared uint maxDepth;
+shared uint minNormal[3];
+shared uint maxNormal[3];
+
+// One texel per 8x8 tile: 1 where SSDO needs the full sample count (creases,
+// silhouettes), 0 on flat tiles and background.
+void main()
+{
+    if (gl_LocalInvocationIndex == 0)
+    {
+        minDepth = floatBitsToUint(1e30);
+        maxDepth = 0u;
+        for (int c = 0; c != 3; ++c)
+        {
+            minNormal[c] = floatBitsToUint(2.0);
+            maxNormal[c] = 0u;
+        }
+    }
+    barrier();
+
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (all(lessThan(pixel, textureSize(textureDepth, 0))))
+    {
+        vec4 fragPos = loadPosition(pixel);
+        if (fragPos.w != 0.0)
+        {
+            atomicMin(minDepth, floatBitsToUint(-fragPos.z));
+            atomicMax(maxDepth, floatBitsToUint(-fragPos.z));
+            vec3 normal = loadNormal(pixel) + 1.0;
+            for (int c = 0; c != 3; ++c)
+            {
+                atomicMin(minNormal[c], floatBitsToUint(normal[c]));
+                atomicMax(maxNormal[c], floatBitsToUint(normal[c]));
+            }
+        }
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0)
+    {
+        uint complex = 0u;
+        if (maxDepth != 0u)
+        {
+            float depthRange = (uintBitsToFloat(maxDepth) - uintBitsToFloat(minDepth)) / uintBitsToFloat(minDepth);
+            vec3 normalExtent = vec3(0.0);
+            for (int c = 0; c != 3; ++c)
+                normalExtent[c] = uintBitsToFloat(maxNormal[c]) - uintBitsToFloat(minNormal[c]);
+            complex = depthRange > depthThreshold || length(normalExtent) > normalThreshold ? 1u : 0u;
+        }
+        imageStore(imageTiles, ivec2(gl_WorkGroupID.xy), uvec4(complex));
+    }
+}
@@ -0,0 +1,23 @@
+# version 450 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (rgba16f, binding = 0) uniform writeonly image2DArray layerPosition;
+layout (rgba16f, binding = 1) uniform writeonly image2DArray layerNormal;
+layout (rgba8, binding = 2) uniform writeonly image2DArray layerAlbedo;
+
+#include "gbuffer.glsl"
+
+// Pixel (x, y) goes to texel (x / 4, y / 4) of layer (y % 4) * 4 + x % 4,
+// so every layer holds the pixels sharing one 4x4 noise rotation.
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, textureSize(textureDepth, 0))))
+        return;
+
+    ivec3 dst = ivec3(pixel / 4, (pixel.y % 4) * 4 + pixel.x % 4);
+    imageStore(layerPosition, dst, loadPosition(pixel));
+    imageStore(layerNormal, dst, vec4(loadNormal(pixel), 0.0));
+    imageStore(layerAlbedo, dst, texelFetch(textureAlbedo, pixel, 0));
+}
@@ -0,0 +1,98 @@
+# version 450 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (rgba8, binding = 0) uniform writeonly image2DArray layerDirect;
+layout (rgba8, binding = 1) uniform writeonly image2DArray layerIndirect;
+
+uniform sampler2DArray layerPosition;
+uniform sampler2DArray layerNormal;
+uniform sampler2DArray layerAlbedo;
+uniform sampler2D textureNoise;
+
+uniform vec3 kernel[64];
+uniform mat4 projMat;
+
+// a frame evaluates kernel[sampleOffset] .. kernel[sampleOffset + sampleCount - 1],
+// with the tangent frame rotated by rotation around the normal
+uniform int sampleCount;
+uniform int sampleOffset;
+uniform float rotation;
+
+uniform int AOType;
+uniform float radius;
+uniform ivec2 screenSize;
+
+const float bias = 0.000;
+const float area = 10;
+
+#include "environment.glsl"
+
+// Same computation as fused.fs on one quarter-resolution layer (z of the
+// dispatch). Samples are taken from the nearest texel of the same layer, so
+// all invocations of a layer share one rotation and one access pattern.
+void main()
+{
+    int layer = int(gl_GlobalInvocationID.z);
+    ivec2 layerOffset = ivec2(layer % 4, layer / 4);
+    ivec2 layerSize = textureSize(layerPosition, 0).xy;
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, layerSize)))
+        return;
+
+    vec4 center    = texelFetch(layerPosition, ivec3(texel, layer), 0);
+    // background, its result is never read
+    if (center.w == 0.0)
+        return;
+    vec3 fragPos   = center.xyz;
+    vec3 normal    = texelFetch(layerNormal, ivec3(texel, layer), 0).xyz;
+    vec3 randomVec = texelFetch(textureNoise, layerOffset, 0).xyz;
+
+    vec3 tangent   = normalize(randomVec - normal * dot(randomVec, normal));
+    vec3 bitangent = cross(normal, tangent);
+    tangent        = cos(rotation) * tangent + sin(rotation) * bitangent;
+    bitangent      = cross(normal, tangent);
+    mat3 TBN       = mat3(tangent, bitangent, normal);
+
+    vec3 occlusion = vec3(0.0);
+    vec3 bounce = vec3(0.0);
+    for(int n = 0; n < sampleCount; ++n)
+    {
+        vec3 dir = TBN * kernel[(sampleOffset + n) % 64];
+        vec3 s = fragPos + dir * radius;
+        vec4 offset = vec4(s, 1.0);
+
+        offset = projMat * offset;
+        offset.xyz /= offset.w;
+        offset.xyz = offset.xyz * 0.5 + 0.5;
+
+        vec2 samplePixel = offset.xy * vec2(screenSize);
+        ivec2 sampleTexel = ivec2(floor((samplePixel - vec2(layerOffset) + 1.5) / 4.0));
+        ivec3 src = ivec3(clamp(sampleTexel, ivec2(0), layerSize - 1), layer);
+
+        float sampleDepth = texelFetch(layerPosition, src, 0).z;
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+        if (AOType == 0)
+        {
+            if (sampleDepth >= s.z + bias)
+                occlusion += Illuminance(dir) * dot(normal, normalize(dir)) * rangeCheck * 0.5;
+        } else
+        if (AOType == 1)
+            occlusion += vec3(sampleDepth >= s.z + bias ? 1.0 : 0.0) * rangeCheck;
+        else if (AOType == 2)
+            occlusion += vec3(1.0);
+
+        vec3 Snorm = texelFetch(layerNormal, src, 0).xyz;
+        vec3 SR = normalize(fragPos-s);
+        float thetaS = dot(Snorm, SR);
+        if (sampleDepth < s.z + bias && abs(sampleDepth-s.z) < 0.5 && thetaS > 0.0)
+        {
+            vec3 sampleColor = texelFetch(layerAlbedo, src, 0).rgb;
+            float dis = max(1.0, length(s - fragPos));
+            float thetaR = abs(dot(normal, SR));
+            bounce += sampleColor * area * thetaS * thetaR / dis / dis;
+        }
+    }
+    imageStore(layerDirect, ivec3(texel, layer), vec4(occlusion / float(sampleCount), 1.0));
+    imageStore(layerIndirect, ivec3(texel, layer), vec4(bounce / float(sampleCount), 1.0));
+}
@@ -0,0 +1,39 @@
+# version 450 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f, binding = 0) uniform readonly image2D srcLevel;
+layout (r32f, binding = 1) uniform writeonly image2D dstLevel;
+
+#include "gbuffer.glsl"
+
+uniform int level;
+
+// background is pushed to the far plane so it never occludes
+const float farDepth = -500.0;
+
+// Level 0 copies view-space z out of the G-buffer, every other level keeps
+// the maximum (nearest to the camera) of the 2x2 texels below it, plus the
+// extra row/column when the lower level has an odd size.
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, imageSize(dstLevel))))
+        return;
+
+    if (level == 0)
+    {
+        vec4 fragPos = loadPosition(texel);
+        imageStore(dstLevel, texel, vec4(fragPos.w == 0.0 ? farDepth : fragPos.z));
+        return;
+    }
+
+    ivec2 srcSize = imageSize(srcLevel);
+    ivec2 base = texel * 2;
+    ivec2 last = min(base + 1 + (srcSize & 1) * ivec2(equal(texel, imageSize(dstLevel) - 1)), srcSize - 1);
+    float depth = farDepth;
+    for (int y = base.y; y <= last.y; ++y)
+        for (int x = base.x; x <= last.x; ++x)
+            depth = max(depth, imageLoad(srcLevel, ivec2(x, y)).r);
+    imageStore(dstLevel, texel, vec4(depth));
+}
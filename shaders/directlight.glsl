@@ -0,0 +1,19 @@
+// Direct light of the scene light on a world-space surface through the
+// shadow map, shared by the passes that capture the lit scene outside the
+// G-buffer. Same shadow test as geometry.fs.
+
+uniform sampler2D textureShadow;
+uniform mat4 lightMat;
+uniform vec3 lightPos;
+uniform vec3 lightDir;
+uniform vec3 lightDiffuse;
+
+// albedo * diffuse light * shadow, like radiancepyramid.cs level 0
+vec3 LitRadiance(vec3 worldPos, vec3 norm, vec3 albedo)
+{
+    vec4 lightSpacePos = lightMat * vec4(worldPos, 1.0);
+    vec3 shadowPos = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+    float bias = max(0.0005 * (1.0 - dot(norm, normalize(lightDir))), 0.0);
+    float lighted = shadowPos.z > 1.0 ? 1.0 : step(shadowPos.z, texture(textureShadow, shadowPos.xy).r + bias);
+    return albedo * lightDiffuse * max(dot(norm, normalize(lightPos - worldPos)), 0.0) * lighted;
+}
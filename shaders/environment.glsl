@@ -0,0 +1,56 @@
+// Environment lighting shared by the SSDO passes. Directions are in view
+// space and are flipped into world space by invViewRot.
+
+uniform samplerCube textureCubeMap;
+// textureCubeMap convolved over cones whose aperture grows linearly with
+// the mip level, from a single direction to a hemisphere, see prefilter.fs
+uniform samplerCube textureEnvironment;
+uniform mat3 invViewRot;
+uniform sampler2D textureHDR;
+
+// World-space directions importance-sampled from the luminance of
+// textureHDR, solid-angle pdf in w, see SkyBox::sampleEnvironment
+const int envPoolSize = 256;
+layout (std140, binding = 1) uniform EnvironmentSamples
+{
+    vec4 envSamples[envPoolSize];
+};
+
+const float halfPi = 1.57079633;
+const float twoPi = 6.28318531;
+
+vec3 Illuminance(vec3 v)
+{
+    vec3 dir = invViewRot * -v;
+    vec3 hdr = texture(textureCubeMap, dir.xyz).rgb;
+    return hdr;
+}
+
+// Radiance from world direction dir, looked up in the equirectangular map
+// the way capture.fs does
+vec3 HDRRadiance(vec3 dir)
+{
+    vec2 uv = vec2(atan(dir.z, dir.x), asin(dir.y)) * vec2(0.1591, 0.3183) + 0.5;
+    return texture(textureHDR, uv).rgb;
+}
+
+// Average environment light over the cone around axis with the given
+// half-angle, as one prefiltered lookup.
+vec3 ConeIlluminance(vec3 axis, float aperture)
+{
+    float lod = aperture / halfPi * float(textureQueryLevels(textureEnvironment) - 1);
+    return textureLod(textureEnvironment, invViewRot * -axis, lod).rgb;
+}
+
+// Replaces the per-sample Illuminance sum: the unoccluded directions are
+// summed into bent with weights summing to weight, and the spread of the
+// bent normal gives the cone aperture (a uniform cone of half-angle a has a
+// mean direction of length (1 + cos a) / 2).
+vec3 BentNormalIlluminance(vec3 bent, float weight)
+{
+    if (weight <= 0.0)
+        return vec3(0.0);
+    float spread = length(bent) / weight;
+    float aperture = acos(clamp(2.0 * spread - 1.0, 0.0, 1.0));
+    return ConeIlluminance(normalize(bent), aperture) * weight;
+}
@@ -0,0 +1,111 @@
+# version 450 core
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 outDirect;
+layout (location = 1) out vec4 outIndirect;
+
+#include "gbuffer.glsl"
+
+uniform sampler2D textureNoise;
+uniform sampler2D textureDepthPyramid;
+
+uniform vec3 kernel[64];
+uniform mat4 projMat;
+
+// a frame evaluates kernel[sampleOffset] .. kernel[sampleOffset + sampleCount - 1],
+// with the tangent frame rotated by rotation around the normal
+uniform int sampleCount;
+uniform int sampleOffset;
+uniform float rotation;
+
+// with depthPyramid set, sample depth comes from the mip of textureDepthPyramid
+// matching the sample's screen-space distance (Scalable Ambient Obscurance)
+uniform int depthPyramid;
+const int logMaxOffset = 3;
+const int maxMipLevel = 5;
+
+uniform int AOType;
+// with bentNormal set, direct light is one prefiltered environment lookup
+// along the bent normal instead of one cubemap fetch per sample
+uniform int bentNormal;
+uniform float radius;
+
+const float bias = 0.000;
+const float area = 10;
+
+#include "environment.glsl"
+
+// SSDO direct and one-bounce indirect in one loop: every kernel sample is
+// projected and its position/normal fetched once, and both terms use it.
+void main()
+{
+    vec3 fragPos   = readPosition(texCoord).xyz;
+    vec3 normal    = readNormal(texCoord);
+    vec3 randomVec = texelFetch(textureNoise, ivec2(gl_FragCoord.xy) % textureSize(textureNoise, 0), 0).xyz;
+
+    vec3 tangent   = normalize(randomVec - normal * dot(randomVec, normal));
+    vec3 bitangent = cross(normal, tangent);
+    tangent        = cos(rotation) * tangent + sin(rotation) * bitangent;
+    bitangent      = cross(normal, tangent);
+    mat3 TBN       = mat3(tangent, bitangent, normal);
+
+    vec3 occlusion = vec3(0.0);
+    vec3 bent = vec3(0.0);
+    float bentWeight = 0.0;
+    vec3 bounce = vec3(0.0);
+    for(int n = 0; n < sampleCount; ++n)
+    {
+        vec3 dir = TBN * kernel[(sampleOffset + n) % 64];
+        vec3 s = fragPos + dir * radius;
+        vec4 offset = vec4(s, 1.0);
+
+        offset = projMat * offset;
+        offset.xyz /= offset.w;
+        offset.xyz = offset.xyz * 0.5 + 0.5;
+
+        float sampleDepth;
+        if (depthPyramid == 1)
+        {
+            float ssR = length((offset.xy - texCoord) * vec2(textureSize(textureDepthPyramid, 0)));
+            int level = clamp(findMSB(int(ssR)) - logMaxOffset, 0, maxMipLevel);
+            sampleDepth = textureLod(textureDepthPyramid, offset.xy, float(level)).r;
+        }
+        else
+            sampleDepth = readPosition(offset.xy).z;
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+        if (AOType == 0)
+        {
+            if (sampleDepth >= s.z + bias)
+            {
+                float w = dot(normal, normalize(dir)) * rangeCheck * 0.5;
+                if (bentNormal == 1)
+                {
+                    bent += normalize(dir) * w;
+                    bentWeight += w;
+                }
+                else
+                    occlusion += Illuminance(dir) * w;
+            }
+        } else
+        if (AOType == 1)
+            occlusion += vec3(sampleDepth >= s.z + bias ? 1.0 : 0.0) * rangeCheck;
+        else if (AOType == 2)
+            occlusion += vec3(1.0);
+
+        vec3 Snorm = readNormal(offset.xy);
+        vec3 SR = normalize(fragPos-s);
+        float thetaS = dot(Snorm, SR);
+        if (sampleDepth < s.z + bias && abs(sampleDepth-s.z) < 0.5 && thetaS > 0.0)
+        {
+            vec3 sampleColor = texture(textureAlbedo, offset.xy).rgb;
+            float dis = max(1.0, length(s - fragPos));
+            float thetaR = abs(dot(normal, SR));
+            bounce += sampleColor * area * thetaS * thetaR / dis / dis;
+        }
+    }
+    if (AOType == 0 && bentNormal == 1)
+        occlusion = BentNormalIlluminance(bent, bentWeight);
+    outDirect = vec4(occlusion / float(sampleCount), 1.0);
+    outIndirect = vec4(bounce / float(sampleCount), 1.0);
+}
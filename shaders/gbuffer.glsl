@@ -0,0 +1,70 @@
+// Compact G-buffer layout and decode helpers, included by every pass that
+// writes or reads the G-buffer.
+//
+//   textureDepth   depth attachment, view-space position is rebuilt from it
+//   textureNormal  RGB10A2: octahedral normal (rg), shininess / 10 (b), shadow (a)
+//   textureAlbedo  RGBA8: albedo (rgb)
+
+layout (std140, binding = 0) uniform GBufferParams
+{
+    mat4 invProjMat;
+};
+
+uniform sampler2D textureDepth;
+uniform sampler2D textureNormal;
+uniform sampler2D textureAlbedo;
+
+vec2 octWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+    return e * 0.5 + 0.5;
+}
+vec3 decodeNormal(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = octWrap(n.xy);
+    return normalize(n);
+}
+
+vec3 reconstructPosition(vec2 uv, float depth)
+{
+    vec4 view = invProjMat * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return view.xyz / view.w;
+}
+
+// View-space position, (0, 0, 0, 0) on background like the old position buffer.
+vec4 readPosition(vec2 uv)
+{
+    float depth = texture(textureDepth, uv).r;
+    return depth == 1.0 ? vec4(0.0) : vec4(reconstructPosition(uv, depth), 1.0);
+}
+vec4 loadPosition(ivec2 p)
+{
+    float depth = texelFetch(textureDepth, p, 0).r;
+    vec2 uv = (vec2(p) + 0.5) / vec2(textureSize(textureDepth, 0));
+    return depth == 1.0 ? vec4(0.0) : vec4(reconstructPosition(uv, depth), 1.0);
+}
+
+vec3 readNormal(vec2 uv)
+{
+    return decodeNormal(texture(textureNormal, uv).rg);
+}
+vec3 loadNormal(ivec2 p)
+{
+    return decodeNormal(texelFetch(textureNormal, p, 0).rg);
+}
+float readShininess(vec2 uv)
+{
+    return texture(textureNormal, uv).b * 10.0;
+}
+float readShadow(vec2 uv)
+{
+    return texture(textureNormal, uv).a;
+}
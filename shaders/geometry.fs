@@ -6,10 +6,10 @@ in vec2 texCoord;
 in mat3 TBN;
 in vec4 lightSpacePos;
 
-layout (location = 0) out vec4 outPosition;
-layout (location = 1) out vec3 outNormal;
-layout (location = 2) out vec4 outAlbedo;
-layout (location = 3) out float outLight;
+layout (location = 0) out vec4 outNormal;
+layout (location = 1) out vec4 outAlbedo;
+
+#include "gbuffer.glsl"
 
 uniform sampler2D textureDiffuse;
 uniform sampler2D textureNormals;
@@ -22,14 +22,14 @@ uniform float shininess;
 
 void main()
 {
-    outPosition = vec4(fragPos, 1.0);
-    outNormal = normalize(TBN * (texture(textureNormals, texCoord).rgb * 2.0 - 1.0));
-    // outNormal = normal;
-    outAlbedo = vec4(texture(textureDiffuse, texCoord).rgb, shininess / 10.0);
+    vec3 norm = normalize(TBN * (texture(textureNormals, texCoord).rgb * 2.0 - 1.0));
+    // vec3 norm = normal;
+    outAlbedo = vec4(texture(textureDiffuse, texCoord).rgb, 1.0);
     vec3 light = lightSpacePos.xyz / lightSpacePos.w;
     vec3 shadowPos = light * 0.5 + 0.5;
 
-    float bias = max(0.0005 * (1.0 - dot(outNormal, normalize(lightDir))), 0.0);
-    outLight = shadowPos.z > 1.0 ? 1.0 : step(shadowPos.z, texture(textureShadow, shadowPos.xy).r + bias);
-    // outLight = texture(textureShadow, shadowPos.xy).r;
+    float bias = max(0.0005 * (1.0 - dot(norm, normalize(lightDir))), 0.0);
+    float lighted = shadowPos.z > 1.0 ? 1.0 : step(shadowPos.z, texture(textureShadow, shadowPos.xy).r + bias);
+    // float lighted = texture(textureShadow, shadowPos.xy).r;
+    outNormal = vec4(encodeNormal(norm), shininess / 10.0, lighted);
 }
\ No newline at end of file
@@ -17,6 +17,8 @@ uniform mat4 WVP;
 uniform mat4 WV;
 uniform mat4 lightMat;
 
+invariant gl_Position;
+
 void main()
 {
     fragPos = (WV *  vec4(position, 1.0)).xyz;
@@ -0,0 +1,104 @@
+# version 450 core
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 outDirect;
+layout (location = 1) out vec4 outIndirect;
+
+#include "gbuffer.glsl"
+
+uniform sampler2D textureNoise;
+
+uniform mat4 projMat;
+// slice angle offset, advanced every frame under temporal accumulation
+uniform float rotation;
+uniform vec3 lightAmbient;
+
+// sliceCount * 2 * stepCount depth fetches per pixel
+const int sliceCount = 2;
+const int stepCount = 4;
+const float radius = 0.1;
+const float maxScreenRadius = 64.0;
+const float pi = 3.14159265;
+const float halfPi = 1.57079633;
+
+// Jimenez et al. 2016, fit of the visibility seen through any number of
+// bounces off surroundings of the same albedo
+vec3 multiBounce(float visibility, vec3 albedo)
+{
+    vec3 a = 2.0404 * albedo - 0.3324;
+    vec3 b = -4.7951 * albedo + 0.6417;
+    vec3 c = 2.7552 * albedo + 0.6903;
+    return max(vec3(visibility), ((visibility * a + b) * visibility + c) * visibility);
+}
+
+// Ground-truth ambient occlusion (Jimenez et al. 2016): each slice through
+// the view vector finds the highest horizon on both sides by marching the
+// depth buffer, and the cosine-weighted visibility between the two horizons
+// is integrated in closed form. outDirect holds the visibility like the SSAO
+// term, outIndirect the extra light of the colored multi-bounce fit.
+void main()
+{
+    vec3 fragPos = readPosition(texCoord).xyz;
+    vec3 normal = readNormal(texCoord);
+    vec3 viewVec = normalize(-fragPos);
+    vec2 screenSize = vec2(textureSize(textureDepth, 0));
+
+    // per-pixel slice rotation from the noise texture, step jitter from
+    // interleaved gradient noise
+    vec2 randomVec = texelFetch(textureNoise, ivec2(gl_FragCoord.xy) % textureSize(textureNoise, 0), 0).xy;
+    float sliceNoise = atan(randomVec.y, randomVec.x) / (2.0 * pi) + 0.5;
+    float stepNoise = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+
+    float screenRadius = min(radius * projMat[1][1] * 0.5 * screenSize.y / -fragPos.z, maxScreenRadius);
+    float stepPixels = max(screenRadius / float(stepCount), 1.0);
+
+    float visibility = 0.0;
+    for (int slice = 0; slice < sliceCount; ++slice)
+    {
+        float phi = (float(slice) + sliceNoise) / float(sliceCount) * pi + rotation;
+        vec2 omega = vec2(cos(phi), sin(phi));
+        vec3 directionVec = vec3(omega, 0.0);
+        vec3 orthoDirectionVec = directionVec - dot(directionVec, viewVec) * viewVec;
+        vec3 axisVec = normalize(cross(orthoDirectionVec, viewVec));
+        vec3 projectedNormal = normal - axisVec * dot(normal, axisVec);
+        float projectedLength = length(projectedNormal);
+        float signNorm = sign(dot(orthoDirectionVec, projectedNormal));
+        float cosNorm = clamp(dot(projectedNormal, viewVec) / max(projectedLength, 1e-4), 0.0, 1.0);
+        float n = signNorm * acos(cosNorm);
+
+        // horizons start at the tangent plane
+        float lowHorizonCos0 = cos(n + halfPi);
+        float lowHorizonCos1 = cos(n - halfPi);
+        float horizonCos0 = lowHorizonCos0;
+        float horizonCos1 = lowHorizonCos1;
+        for (int step = 0; step < stepCount; ++step)
+        {
+            vec2 offset = omega * (float(step) + stepNoise + 1.0) * stepPixels / screenSize;
+            vec4 sample0 = readPosition(texCoord + offset);
+            vec4 sample1 = readPosition(texCoord - offset);
+            vec3 delta0 = sample0.xyz - fragPos;
+            vec3 delta1 = sample1.xyz - fragPos;
+            // fade samples beyond radius back to the tangent plane
+            float weight0 = sample0.w * clamp(1.0 - dot(delta0, delta0) / (radius * radius), 0.0, 1.0);
+            float weight1 = sample1.w * clamp(1.0 - dot(delta1, delta1) / (radius * radius), 0.0, 1.0);
+            float shc0 = mix(lowHorizonCos0, dot(normalize(delta0), viewVec), weight0);
+            float shc1 = mix(lowHorizonCos1, dot(normalize(delta1), viewVec), weight1);
+            horizonCos0 = max(horizonCos0, shc0);
+            horizonCos1 = max(horizonCos1, shc1);
+        }
+
+        float h0 = -acos(clamp(horizonCos1, -1.0, 1.0));
+        float h1 = acos(clamp(horizonCos0, -1.0, 1.0));
+        h0 = n + clamp(h0 - n, -halfPi, halfPi);
+        h1 = n + clamp(h1 - n, -halfPi, halfPi);
+        float arc0 = (cosNorm + 2.0 * h0 * sin(n) - cos(2.0 * h0 - n)) / 4.0;
+        float arc1 = (cosNorm + 2.0 * h1 * sin(n) - cos(2.0 * h1 - n)) / 4.0;
+        visibility += projectedLength * (arc0 + arc1);
+    }
+    visibility = clamp(visibility / float(sliceCount), 0.0, 1.0);
+
+    vec3 albedo = texture(textureAlbedo, texCoord).rgb;
+    outDirect = vec4(vec3(visibility), 1.0);
+    outIndirect = vec4(lightAmbient * albedo * (multiBounce(visibility, albedo) - visibility), 1.0);
+}
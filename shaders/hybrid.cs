@@ -0,0 +1,193 @@
+# version 450 core
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (rgba8, binding = 0) uniform writeonly image2D imageDirect;
+
+#include "gbuffer.glsl"
+
+uniform sampler2D textureNoise;
+
+uniform vec3 kernel[64];
+uniform mat4 projMat;
+uniform mat4 invViewMat;
+
+// a frame evaluates kernel[sampleOffset] .. kernel[sampleOffset + sampleCount - 1],
+// with the tangent frame rotated by rotation around the normal
+uniform int sampleCount;
+uniform int sampleOffset;
+uniform float rotation;
+
+uniform int AOType;
+
+// same kernel radius as ssdo.fs
+const float radius = 0.01;
+const float bias = 0.000;
+// a sample behind more than this of geometry may as well lie in empty space
+// the depth buffer never saw
+const float thickness = radius;
+// rays leave slightly above the surface so they miss its own triangles
+const float rayOffset = 0.05 * radius;
+
+// World-space BVH of the whole scene, see SSDORenderer::setScene. Same
+// layout as BVHNode; triangles are three vertices each, w unused.
+struct BVHNode
+{
+    vec3 boundsMin;
+    int offset;
+    vec3 boundsMax;
+    int count;
+};
+layout (std430, binding = 6) readonly buffer SceneNodes
+{
+    BVHNode nodes[];
+};
+layout (std430, binding = 7) readonly buffer SceneTriangles
+{
+    vec4 triangles[];
+};
+uniform int sceneNodeCount;
+// bvhStackSize in scene.cpp; BVH::build keeps the tree shallow enough that
+// the traversal below never overflows it
+const int stackSize = 64;
+
+// kernel samples taken and samples traced in world space
+uniform int collectStats;
+layout (std430, binding = 5) buffer HybridStats
+{
+    uint statSamples;
+    uint statTraced;
+};
+
+#include "environment.glsl"
+
+// Möller-Trumbore, true for a hit with 0 < t < tMax
+bool intersectTriangle(vec3 origin, vec3 dir, vec3 a, vec3 b, vec3 c, float tMax)
+{
+    vec3 e1 = b - a;
+    vec3 e2 = c - a;
+    vec3 p = cross(dir, e2);
+    float det = dot(e1, p);
+    if (det == 0.0)
+        return false;
+    float invDet = 1.0 / det;
+    vec3 s = origin - a;
+    float u = dot(s, p) * invDet;
+    if (u < 0.0 || u > 1.0)
+        return false;
+    vec3 q = cross(s, e1);
+    float v = dot(dir, q) * invDet;
+    if (v < 0.0 || u + v > 1.0)
+        return false;
+    float t = dot(e2, q) * invDet;
+    return t > 0.0 && t < tMax;
+}
+
+// Any-hit traversal like BVH::occluded
+bool occluded(vec3 origin, vec3 dir, float tMax)
+{
+    if (sceneNodeCount == 0)
+        return false;
+    vec3 invDir = 1.0 / vec3(abs(dir.x) > 1e-8 ? dir.x : 1e-8,
+                             abs(dir.y) > 1e-8 ? dir.y : 1e-8,
+                             abs(dir.z) > 1e-8 ? dir.z : 1e-8);
+    int stack[stackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        int nodeIndex = stack[--top];
+        BVHNode node = nodes[nodeIndex];
+        vec3 t0 = (node.boundsMin - origin) * invDir;
+        vec3 t1 = (node.boundsMax - origin) * invDir;
+        vec3 tNear = min(t0, t1);
+        vec3 tFar = max(t0, t1);
+        float enter = max(max(tNear.x, tNear.y), max(tNear.z, 0.0));
+        float exit = min(min(tFar.x, tFar.y), min(tFar.z, tMax));
+        if (enter > exit)
+            continue;
+        if (node.count > 0)
+        {
+            for (int t = node.offset; t < node.offset + node.count; ++t)
+                if (intersectTriangle(origin, dir, triangles[3 * t].xyz, triangles[3 * t + 1].xyz, triangles[3 * t + 2].xyz, tMax))
+                    return true;
+        }
+        else
+        {
+            stack[top++] = node.offset;
+            stack[top++] = nodeIndex + 1;
+        }
+    }
+    return false;
+}
+
+// The kernel loop of ssdo.fs, except that samples the depth buffer cannot
+// answer, off screen or behind more than thickness of geometry, are
+// resolved by a short world-space ray from the surface to the sample.
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 screenSize = textureSize(textureDepth, 0);
+    if (any(greaterThanEqual(pixel, screenSize)))
+        return;
+    vec4 center = loadPosition(pixel);
+    // background, its result is never read
+    if (center.w == 0.0)
+        return;
+    vec3 fragPos   = center.xyz;
+    vec3 normal    = loadNormal(pixel);
+    vec3 randomVec = texelFetch(textureNoise, pixel % textureSize(textureNoise, 0), 0).xyz;
+
+    vec3 tangent   = normalize(randomVec - normal * dot(randomVec, normal));
+    vec3 bitangent = cross(normal, tangent);
+    tangent        = cos(rotation) * tangent + sin(rotation) * bitangent;
+    bitangent      = cross(normal, tangent);
+    mat3 TBN       = mat3(tangent, bitangent, normal);
+
+    mat3 toWorld = mat3(invViewMat);
+    vec3 origin = (invViewMat * vec4(fragPos + normal * rayOffset, 1.0)).xyz;
+
+    vec3 occlusion = vec3(0.0);
+    uint traced = 0u;
+    for (int n = 0; n < sampleCount; ++n)
+    {
+        vec3 dir = TBN * kernel[(sampleOffset + n) % 64];
+        vec3 s = fragPos + dir * radius;
+        vec4 offset = projMat * vec4(s, 1.0);
+        offset.xyz /= offset.w;
+        offset.xyz = offset.xyz * 0.5 + 0.5;
+
+        bool offscreen = any(lessThan(offset.xy, vec2(0.0))) || any(greaterThan(offset.xy, vec2(1.0)));
+        float sampleDepth = offscreen ? 0.0 : readPosition(offset.xy).z;
+        bool hidden;
+        float rangeCheck;
+        if (offscreen || sampleDepth - s.z > thickness)
+        {
+            vec3 ray = toWorld * dir * radius;
+            hidden = occluded(origin, normalize(ray), length(ray));
+            rangeCheck = 1.0;
+            ++traced;
+        }
+        else
+        {
+            hidden = sampleDepth >= s.z + bias;
+            rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+        }
+
+        if (AOType == 0)
+        {
+            if (hidden)
+                occlusion += Illuminance(dir) * dot(normal, normalize(dir)) * rangeCheck * 0.5;
+        }
+        else if (AOType == 1)
+            occlusion += vec3(hidden ? 1.0 : 0.0) * rangeCheck;
+        else
+            occlusion += vec3(1.0);
+    }
+    if (collectStats == 1)
+    {
+        atomicAdd(statSamples, uint(sampleCount));
+        atomicAdd(statTraced, traced);
+    }
+    imageStore(imageDirect, pixel, vec4(occlusion / float(sampleCount), 1.0));
+}
@@ -4,35 +4,311 @@ in vec2 texCoord;
 
 out vec4 fragColor;
 
-uniform sampler2D texturePosition;
-uniform sampler2D textureNormal;
-uniform sampler2D textureAlbedo;
-uniform sampler2D textureLight;
+#include "gbuffer.glsl"
+
 uniform sampler2D textureNoise;
+uniform sampler2D textureDepthPyramid;
 
 uniform vec3 kernel[64];
 uniform mat4 projMat;
 
-const vec2 noiseScale = vec2(1600.0, 900.0) / 4.0;
+// a frame evaluates kernel[sampleOffset] .. kernel[sampleOffset + sampleCount - 1],
+// with the tangent frame rotated by rotation around the normal
+uniform int sampleCount;
+uniform int sampleOffset;
+uniform float rotation;
+
+// with depthPyramid set, sample depth comes from the mip of textureDepthPyramid
+// matching the sample's screen-space distance (Scalable Ambient Obscurance)
+uniform int depthPyramid;
+const int logMaxOffset = 3;
+const int maxMipLevel = 5;
+
+// with radiancePyramid set, bounce light comes from the lit radiance mips
+// built by radiancepyramid.cs within bounceRadius, see pyramidBounce
+uniform int radiancePyramid;
+uniform float bounceRadius;
+uniform sampler2D textureRadiance;
+uniform sampler2D texturePatchPosition;
+uniform sampler2D texturePatchNormal;
+const int maxRadianceLevel = 6;
+
+// with feedback set, a sample's emitter is the surface's lit color in the
+// previous frame's final image, so each frame adds one more bounce
+uniform int feedback;
+uniform sampler2D texturePrevLit;
+uniform sampler2D texturePrevDepth;
+// current view space to the previous frame's view space
+uniform mat4 toPrevView;
+const float feedbackDepthTolerance = 0.02;
+
+// with voxelCone set, bounce light is cone-traced through the scene's lit
+// surfaces voxelized by voxelize.fs, see voxelBounce
+uniform int voxelCone;
+uniform sampler3D textureVoxels;
+// view space to the voxel grid's unit cube
+uniform mat4 viewToVoxel;
+const int voxelConeCount = 6;
+const int voxelStepCount = 16;
+// cone half-angle of 30 degrees, six of them cover the hemisphere
+const float voxelConeTan = 0.577;
+const float voxelMaxDistance = 0.5;
+// tangent space: one along the normal, five at 60 degrees from it
+const vec3 voxelCones[voxelConeCount] = vec3[](
+    vec3(0.0, 0.0, 1.0),
+    vec3(0.866025, 0.0, 0.5),
+    vec3(0.267617, 0.823639, 0.5),
+    vec3(-0.700629, 0.509037, 0.5),
+    vec3(-0.700629, -0.509037, 0.5),
+    vec3(0.267617, -0.823639, 0.5));
+
+// with probeGrid set, bounce light is interpolated from the baked
+// irradiance probes around the surface, see probeBounce
+uniform int probeGrid;
+uniform mat4 invViewMat;
+uniform vec3 probeGridMin;
+uniform float probeSpacing;
+uniform ivec3 probeCounts;
+// every probe's distance moments in a probeMomentSize square tile,
+// octahedrally mapped, tiles row by row
+uniform sampler2D textureProbeMoments;
+uniform int probeTilesPerRow;
+const int probeMomentSize = 8;
+// the surface point is pushed off along its normal by this many spacings
+const float probeNormalBias = 0.1;
+// Per probe the 9 SH coefficients of the radiance reaching it, see
+// SSDORenderer::updateProbes
+layout (std430, binding = 5) readonly buffer ProbeSH
+{
+    vec4 probeSH[];
+};
 
 const float radius = 0.1;
 const float bias = 0.000;
 const float area = 10;
 
+#include "adaptive.glsl"
+
+// The kernel scaled to bounceRadius, each sample reading the radiance mip
+// level matching its screen-space distance like the depth pyramid. A texel
+// of that level is one emitter patch: its averaged radiance, position and
+// normal stand in for every surface it covers, so wider radii cost no more
+// samples. Patch area grows with the radius, keeping brightness constant.
+vec3 pyramidBounce(vec3 fragPos, vec3 normal, mat3 TBN)
+{
+    vec2 screenSize = vec2(textureSize(textureRadiance, 0));
+    float patchArea = area * (bounceRadius / radius) * (bounceRadius / radius);
+    vec3 bounce = vec3(0.0);
+    for (int n = 0; n < sampleCount; ++n)
+    {
+        vec3 s = fragPos + TBN * kernel[(sampleOffset + n) % 64] * bounceRadius;
+        vec4 offset = projMat * vec4(s, 1.0);
+        offset.xy = offset.xy / offset.w * 0.5 + 0.5;
+
+        float ssR = length((offset.xy - texCoord) * screenSize);
+        float level = float(clamp(findMSB(int(ssR)) - logMaxOffset, 0, maxRadianceLevel));
+        vec4 patchPos = textureLod(texturePatchPosition, offset.xy, level);
+        if (patchPos.w == 0.0)
+            continue;
+        vec3 patchNormal = textureLod(texturePatchNormal, offset.xy, level).xyz;
+        vec3 radiance = textureLod(textureRadiance, offset.xy, level).rgb;
+
+        // same acceptance as the kernel loop, tolerance scaled with the radius
+        vec3 SR = fragPos - patchPos.xyz;
+        float thetaS = dot(patchNormal, normalize(SR));
+        if (patchPos.z < s.z + bias && abs(patchPos.z - s.z) < 5.0 * bounceRadius && thetaS > 0.0)
+        {
+            float dis = max(1.0, length(SR));
+            float thetaR = abs(dot(normal, normalize(SR)));
+            bounce += radiance * patchPos.w * patchArea * thetaS * thetaR / dis / dis;
+        }
+    }
+    return bounce / float(sampleCount);
+}
+
+// Front-to-back accumulation along one cone, reading the mip whose voxels
+// match the cone's diameter. Each step advances half a diameter, so the
+// step count is fixed by the aperture, not by the resolution.
+vec3 traceCone(vec3 origin, vec3 dir)
+{
+    float res = float(textureSize(textureVoxels, 0).x);
+    vec4 accum = vec4(0.0);
+    float t = 1.0 / res;
+    for (int n = 0; n < voxelStepCount && t < voxelMaxDistance && accum.a < 0.95; ++n)
+    {
+        vec3 p = origin + dir * t;
+        if (any(lessThan(p, vec3(0.0))) || any(greaterThan(p, vec3(1.0))))
+            break;
+        float diameter = max(1.0 / res, 2.0 * t * voxelConeTan);
+        // radiance is premultiplied by coverage, empty voxels average in as 0
+        accum += (1.0 - accum.a) * textureLod(textureVoxels, p, log2(diameter * res));
+        t += 0.5 * diameter;
+    }
+    return accum.rgb;
+}
+
+// Light reaching the surface through six cosine-weighted cones, reflected
+// by its albedo. Off-screen and hidden emitters count like visible ones.
+vec3 voxelBounce(vec3 fragPos, vec3 normal, mat3 TBN, vec3 albedo)
+{
+    mat3 toVoxel = mat3(viewToVoxel);
+    vec3 voxelNormal = normalize(toVoxel * normal);
+    // leave the surface's own voxel before the first lookup
+    vec3 origin = (viewToVoxel * vec4(fragPos, 1.0)).xyz + voxelNormal * 1.5 / float(textureSize(textureVoxels, 0).x);
+    vec3 bounce = vec3(0.0);
+    float weightSum = 0.0;
+    for (int n = 0; n < voxelConeCount; ++n)
+    {
+        float w = voxelCones[n].z;
+        bounce += traceCone(origin, normalize(toVoxel * (TBN * voxelCones[n]))) * w;
+        weightSum += w;
+    }
+    return albedo * bounce / weightSum;
+}
+
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy;
+}
+
+// Mean distance and mean squared distance probe index sees toward dir
+vec2 probeMoments(int index, vec3 dir)
+{
+    vec2 tile = vec2(index % probeTilesPerRow, index / probeTilesPerRow) * float(probeMomentSize);
+    vec2 local = clamp((octEncode(dir) * 0.5 + 0.5) * float(probeMomentSize), vec2(0.5), vec2(probeMomentSize - 0.5));
+    return texture(textureProbeMoments, (tile + local) / vec2(textureSize(textureProbeMoments, 0))).rg;
+}
+
+// Irradiance / pi from the probe's radiance SH: the SH convolved with the
+// clamped cosine, bands weighted by pi, 2 pi / 3 and pi / 4.
+vec3 probeRadiance(int index, vec3 n)
+{
+    float basis[9] = float[](
+        0.282095,
+        0.488603 * n.y,
+        0.488603 * n.z,
+        0.488603 * n.x,
+        1.092548 * n.x * n.y,
+        1.092548 * n.y * n.z,
+        0.315392 * (3.0 * n.z * n.z - 1.0),
+        1.092548 * n.x * n.z,
+        0.546274 * (n.x * n.x - n.y * n.y));
+    vec3 irradiance = vec3(0.0);
+    for (int l = 0; l < 9; ++l)
+    {
+        float band = l == 0 ? 1.0 : l < 4 ? 2.0 / 3.0 : 0.25;
+        irradiance += probeSH[index * 9 + l].rgb * basis[l] * band;
+    }
+    return max(irradiance, vec3(0.0));
+}
+
+// The eight probes of the surrounding cell, trilinearly weighted, with
+// probes behind the surface faded and probes whose depth moments say the
+// surface is hidden from them rejected (Chebyshev), so light does not leak
+// through walls. Reflected by the surface's albedo.
+vec3 probeBounce(vec3 fragPos, vec3 normal, vec3 albedo)
+{
+    vec3 worldPos = (invViewMat * vec4(fragPos, 1.0)).xyz;
+    vec3 worldNormal = normalize(mat3(invViewMat) * normal);
+    vec3 biasedPos = worldPos + worldNormal * probeNormalBias * probeSpacing;
+    vec3 gridPos = (biasedPos - probeGridMin) / probeSpacing;
+    ivec3 base = clamp(ivec3(floor(gridPos)), ivec3(0), probeCounts - 2);
+    vec3 alpha = clamp(gridPos - vec3(base), 0.0, 1.0);
+
+    vec3 bounce = vec3(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 8; ++i)
+    {
+        ivec3 offset = ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        ivec3 cell = base + offset;
+        int index = (cell.z * probeCounts.y + cell.y) * probeCounts.x + cell.x;
+        vec3 probePos = probeGridMin + vec3(cell) * probeSpacing;
+
+        vec3 trilinear = mix(1.0 - alpha, alpha, vec3(offset));
+        float w = trilinear.x * trilinear.y * trilinear.z;
+        vec3 toProbe = normalize(probePos - worldPos);
+        float facing = (dot(toProbe, worldNormal) + 1.0) * 0.5;
+        w *= facing * facing + 0.2;
+
+        vec3 fromProbe = biasedPos - probePos;
+        float r = length(fromProbe);
+        vec2 moments = probeMoments(index, fromProbe / max(r, 1e-4));
+        if (r > moments.x)
+        {
+            float variance = abs(moments.y - moments.x * moments.x);
+            float d = r - moments.x;
+            float chebyshev = variance / (variance + d * d);
+            w *= chebyshev * chebyshev * chebyshev;
+        }
+        w = max(w, 1e-5);
+        bounce += probeRadiance(index, worldNormal) * w;
+        weightSum += w;
+    }
+    return albedo * bounce / weightSum;
+}
+
+// Last frame's lit color of the surface seen at uv, alpha 0 where that
+// surface was off screen or hidden behind something else.
+vec4 previousRadiance(vec2 uv)
+{
+    vec4 prevPos = toPrevView * vec4(readPosition(uv).xyz, 1.0);
+    vec4 prevClip = projMat * prevPos;
+    vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+    if (any(lessThan(prevUV, vec2(0.0))) || any(greaterThan(prevUV, vec2(1.0))))
+        return vec4(0.0);
+    float prevDepth = texture(texturePrevDepth, prevUV).r;
+    if (prevDepth == 1.0)
+        return vec4(0.0);
+    vec3 prevSurface = reconstructPosition(prevUV, prevDepth);
+    if (abs(prevSurface.z - prevPos.z) > feedbackDepthTolerance * abs(prevPos.z))
+        return vec4(0.0);
+    return vec4(texture(texturePrevLit, prevUV).rgb, 1.0);
+}
+
 void main()
 {
-    vec3 fragPos   = texture(texturePosition, texCoord).xyz;
-    vec3 normal    = texture(textureNormal, texCoord).rgb;
-    vec3 randomVec = texture(textureNoise, texCoord * noiseScale).xyz;
+    vec3 fragPos   = readPosition(texCoord).xyz;
+    vec3 normal    = readNormal(texCoord);
+    vec3 randomVec = texelFetch(textureNoise, ivec2(gl_FragCoord.xy) % textureSize(textureNoise, 0), 0).xyz;
 
     vec3 tangent   = normalize(randomVec - normal * dot(randomVec, normal));
     vec3 bitangent = cross(normal, tangent);
+    tangent        = cos(rotation) * tangent + sin(rotation) * bitangent;
+    bitangent      = cross(normal, tangent);
     mat3 TBN       = mat3(tangent, bitangent, normal);
 
+    if (radiancePyramid == 1)
+    {
+        recordSamples(1, sampleCount);
+        fragColor = vec4(pyramidBounce(fragPos, normal, TBN), 1.0);
+        return;
+    }
+
+    vec3 albedo = texture(textureAlbedo, texCoord).rgb;
+    if (voxelCone == 1)
+    {
+        recordSamples(1, voxelConeCount);
+        fragColor = vec4(voxelBounce(fragPos, normal, TBN, albedo), 1.0);
+        return;
+    }
+    if (probeGrid == 1)
+    {
+        recordSamples(1, 8);
+        fragColor = vec4(probeBounce(fragPos, normal, albedo), 1.0);
+        return;
+    }
+
     vec3 occlusion = vec3(0.0);
-    for(int i = 0; i < 64; ++i)
+    int cap = adaptiveCap(sampleCount);
+    int taken = 0;
+    float bounceSum = 0.0;
+    float bounceSumSq = 0.0;
+    for(int n = 0; n < cap; ++n)
     {
-        vec3 dir = TBN * kernel[i];
+        vec3 dir = TBN * kernel[(sampleOffset + adaptiveIndex(n, sampleCount)) % 64];
         vec3 s = fragPos + dir * radius;
         vec4 offset = vec4(s, 1.0);
 
@@ -40,20 +316,42 @@ void main()
         offset.xyz /= offset.w;
         offset.xyz = offset.xyz * 0.5 + 0.5;
 
-        float sampleDepth = texture(texturePosition, offset.xy).z;
+        float sampleDepth;
+        if (depthPyramid == 1)
+        {
+            float ssR = length((offset.xy - texCoord) * vec2(textureSize(textureDepthPyramid, 0)));
+            int level = clamp(findMSB(int(ssR)) - logMaxOffset, 0, maxMipLevel);
+            sampleDepth = textureLod(textureDepthPyramid, offset.xy, float(level)).r;
+        }
+        else
+            sampleDepth = readPosition(offset.xy).z;
         // float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
-        vec3 Snorm = texture(textureNormal, offset.xy).xyz;
+        vec3 Snorm = readNormal(offset.xy);
         vec3 SR = normalize(fragPos-s);
         float thetaS = dot(Snorm, SR);
+        // whether the sample lands on a bouncing surface drives the adaptive stop
+        float hit = 0.0;
         if (sampleDepth < s.z + bias && abs(sampleDepth-s.z) < 0.5 && thetaS > 0.0)
         {
             vec3 sampleColor = texture(textureAlbedo, offset.xy).rgb;
             float dis = max(1.0, length(s - fragPos));
             float thetaR = abs(dot(normal, SR));
-            occlusion += sampleColor * area * thetaS * thetaR / dis / dis;
+            // reflected by this surface's albedo and without the area boost,
+            // so the loop through the lit image loses energy every frame
+            if (feedback == 1)
+                occlusion += albedo * previousRadiance(offset.xy).rgb * thetaS * thetaR;
+            else
+                occlusion += sampleColor * area * thetaS * thetaR / dis / dis;
+            hit = 1.0;
         }
+        bounceSum += hit;
+        bounceSumSq += hit * hit;
+        taken = n + 1;
+        if (adaptiveDone(taken, bounceSum, bounceSumSq))
+            break;
     }
-    occlusion /= 64.0;
+    recordSamples(1, taken);
+    occlusion /= float(taken);
     // occlusion = (occlusion / 64.0);
     fragColor = vec4(occlusion, 1.0);
 }
\ No newline at end of file
@@ -4,9 +4,8 @@ in vec2 texCoord;
 
 out vec4 fragColor;
 
-uniform sampler2D texturePosition;
-uniform sampler2D textureNormal;
-uniform sampler2D textureAlbedo;
+#include "gbuffer.glsl"
+
 uniform sampler2D textureLight;
 uniform sampler2D textureDirect;
 uniform sampler2D textureIndirect;
@@ -23,45 +22,31 @@ uniform vec3 lightSpecular;
 uniform int AOType;
 uniform int outputType;
 
+// Only model pixels are lit, eroded by erodeRadius so the silhouette rim,
+// where the screen-space terms are unreliable, keeps the skybox behind it.
+const int erodeRadius = 1;
 
-float blurLight()
-{
-    vec2 texelSize = 1.0 / vec2(textureSize(textureLight, 0));
-    float result = 0.0;
-    for (int x = -3; x < 3; ++x)
-    {
-        for (int y = -3; y < 3; ++y)
-        {
-            vec2 offset = vec2(float(x), float(y)) * texelSize;
-            result += texture(textureLight, texCoord + offset).r;
-        }
-    }
-    return result / (7.0 * 7.0);
-}
-vec3 blurIndirect()
+bool covered(ivec2 p)
 {
-    vec2 texelSize = 1.0 / vec2(textureSize(textureIndirect, 0));
-    vec3 result = vec3(0.0);
-    for (int x = -3; x < 3; ++x)
-    {
-        for (int y = -3; y < 3; ++y)
-        {
-            vec2 offset = vec2(float(x), float(y)) * texelSize;
-            result += texture(textureIndirect, texCoord + offset).rgb;
-        }
-    }
-    return result / (7.0 * 7.0);
+    p = clamp(p, ivec2(0), textureSize(textureDepth, 0) - 1);
+    return texelFetch(textureDepth, p, 0).r != 1.0;
 }
 
 void main()
 {
-    vec3 fragPos   = texture(texturePosition, texCoord).xyz;
-    vec3 norm    = texture(textureNormal, texCoord).rgb;
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (!covered(pixel) ||
+        !covered(pixel + ivec2(erodeRadius, 0)) || !covered(pixel - ivec2(erodeRadius, 0)) ||
+        !covered(pixel + ivec2(0, erodeRadius)) || !covered(pixel - ivec2(0, erodeRadius)))
+        discard;
+
+    vec3 fragPos   = readPosition(texCoord).xyz;
+    vec3 norm    = readNormal(texCoord);
     vec4 color = vec4(texture(textureAlbedo, texCoord).rgb, 1.0);
-    float shininess = texture(textureAlbedo, texCoord).a * 10.0;
-    vec4 AO = texture(textureDirect, texCoord);
-    vec4 bounce = vec4(blurIndirect(), 1.0);
-    float lighted = blurLight();
+    float shininess = readShininess(texCoord);
+    vec4 AO = vec4(texture(textureDirect, texCoord).rgb, 1.0);
+    vec4 bounce = vec4(texture(textureIndirect, texCoord).rgb, 1.0);
+    float lighted = texture(textureLight, texCoord).r;
 
     vec4 ambient = vec4(lightAmbient, 1.0) * color * AO;
 
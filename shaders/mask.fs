@@ -0,0 +1,10 @@
+# version 450 core
+
+#include "gbuffer.glsl"
+
+// Marks model pixels in the stencil mask; background keeps the cleared 0.
+void main()
+{
+    if (texelFetch(textureDepth, ivec2(gl_FragCoord.xy), 0).r == 1.0)
+        discard;
+}
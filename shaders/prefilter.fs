@@ -0,0 +1,39 @@
+#version 450 core
+out vec4 FragColor;
+in vec3 localPos;
+
+uniform samplerCube cubeMap;
+// cone half-angle of the mip level being rendered
+uniform float aperture;
+
+const int sampleCount = 256;
+const float goldenAngle = 2.39996323;
+
+void main()
+{
+    vec3 N = normalize(localPos);
+    if (aperture == 0.0)
+    {
+        FragColor = vec4(textureLod(cubeMap, N, 0.0).rgb, 1.0);
+        return;
+    }
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 T = normalize(cross(up, N));
+    vec3 B = cross(N, T);
+
+    // Fibonacci spiral over the spherical cap, uniform in solid angle,
+    // cosine-weighted like the SSDO samples
+    float cosAperture = cos(aperture);
+    vec3 result = vec3(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < sampleCount; ++i)
+    {
+        float cosTheta = 1.0 - (1.0 - cosAperture) * (float(i) + 0.5) / float(sampleCount);
+        float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+        float phi = float(i) * goldenAngle;
+        vec3 dir = T * cos(phi) * sinTheta + B * sin(phi) * sinTheta + N * cosTheta;
+        result += textureLod(cubeMap, dir, 0.0).rgb * cosTheta;
+        weightSum += cosTheta;
+    }
+    FragColor = vec4(result / weightSum, 1.0);
+}
@@ -0,0 +1,28 @@
+# version 450 core
+
+in vec3 worldPos;
+in vec3 normal;
+in vec2 texCoord;
+
+layout (location = 0) out vec4 outRadiance;
+layout (location = 1) out float outDistance;
+
+uniform sampler2D textureDiffuse;
+uniform vec3 probePos;
+
+#include "directlight.glsl"
+
+// One texel of a probe's cube: the lit surface seen from the probe and its
+// distance. Back faces emit nothing but still occlude, so a probe inside a
+// wall sees only short distances and the depth test rejects it.
+void main()
+{
+    outDistance = length(worldPos - probePos);
+    if (!gl_FrontFacing)
+    {
+        outRadiance = vec4(0.0);
+        return;
+    }
+    vec3 albedo = texture(textureDiffuse, texCoord).rgb;
+    outRadiance = vec4(LitRadiance(worldPos, normalize(normal), albedo), 1.0);
+}
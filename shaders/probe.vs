@@ -0,0 +1,21 @@
+# version 450 core
+
+layout (location=0) in vec3 position;
+layout (location=1) in vec3 inNormal;
+layout (location=2) in vec2 inTexCoord;
+
+out vec3 worldPos;
+out vec3 normal;
+out vec2 texCoord;
+
+uniform mat4 modelMat;
+// one cube face seen from the probe
+uniform mat4 viewProj;
+
+void main()
+{
+    worldPos = (modelMat * vec4(position, 1.0)).xyz;
+    normal = mat3(modelMat) * inNormal;
+    texCoord = inTexCoord;
+    gl_Position = viewProj * vec4(worldPos, 1.0);
+}
@@ -0,0 +1,83 @@
+# version 450 core
+
+// one invocation per texel of the probeMomentSize x probeMomentSize tile
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (rg32f, binding = 0) uniform writeonly image2D imageMoments;
+layout (std430, binding = 5) writeonly buffer ProbeSH
+{
+    vec4 probeSH[];
+};
+
+// the six faces side by side, as probe.fs captured them
+uniform sampler2D textureRadiance;
+uniform sampler2D textureDistance;
+// rotation from each face's capture view to world space
+uniform mat3 faceToWorld[6];
+uniform float momentSharpness;
+uniform int probeIndex;
+uniform int probeTilesPerRow;
+uniform float probeFar;
+
+// Octahedral map of [-1, 1]^2 to the unit sphere, inverse of octEncode in
+// indirect.fs
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+float shBasis(int l, vec3 d)
+{
+    switch (l)
+    {
+    case 0: return 0.282095;
+    case 1: return 0.488603 * d.y;
+    case 2: return 0.488603 * d.z;
+    case 3: return 0.488603 * d.x;
+    case 4: return 1.092548 * d.x * d.y;
+    case 5: return 1.092548 * d.y * d.z;
+    case 6: return 0.315392 * (3.0 * d.z * d.z - 1.0);
+    case 7: return 1.092548 * d.x * d.z;
+    default: return 0.546274 * (d.x * d.x - d.y * d.y);
+    }
+}
+
+// Projects the captured probe onto its slots: every invocation averages the
+// distance and squared distance over its texel's cosine lobe into the
+// moment tile, and the first nine also project the radiance onto one SH
+// coefficient, like SkyBox::projectSH.
+void main()
+{
+    ivec2 texel = ivec2(gl_LocalInvocationID.xy);
+    int momentSize = int(gl_WorkGroupSize.x);
+    vec3 momentDir = octDecode((vec2(texel) + 0.5) / float(momentSize) * 2.0 - 1.0);
+    int l = int(gl_LocalInvocationIndex);
+    int faceSize = textureSize(textureDistance, 0).y;
+
+    vec3 moments = vec3(0.0);
+    vec3 sh = vec3(0.0);
+    for (int face = 0; face < 6; ++face)
+        for (int y = 0; y < faceSize; ++y)
+            for (int x = 0; x < faceSize; ++x)
+            {
+                // the view ray through the texel center, and the texel's solid angle
+                vec2 ndc = (vec2(x, y) + 0.5) / float(faceSize) * 2.0 - 1.0;
+                vec3 ray = vec3(ndc, -1.0);
+                float solidAngle = 4.0 / float(faceSize * faceSize) / pow(dot(ray, ray), 1.5);
+                vec3 dir = normalize(faceToWorld[face] * ray);
+                ivec2 source = ivec2(face * faceSize + x, y);
+                float r = texelFetch(textureDistance, source, 0).r;
+                float w = pow(max(dot(momentDir, dir), 0.0), momentSharpness) * solidAngle;
+                moments += vec3(r * w, r * r * w, w);
+                if (l < 9)
+                    sh += texelFetch(textureRadiance, source, 0).rgb * shBasis(l, dir) * solidAngle;
+            }
+
+    if (l < 9)
+        probeSH[probeIndex * 9 + l] = vec4(sh, 0.0);
+    ivec2 tile = ivec2(probeIndex % probeTilesPerRow, probeIndex / probeTilesPerRow) * momentSize;
+    vec2 mean = moments.z > 0.0 ? moments.xy / moments.z : vec2(probeFar, probeFar * probeFar);
+    imageStore(imageMoments, tile + texel, vec4(mean, 0.0, 0.0));
+}
@@ -0,0 +1,10 @@
+# version 450 core
+
+in vec3 radiance;
+
+out vec4 fragColor;
+
+void main()
+{
+    fragColor = vec4(radiance, 1.0);
+}
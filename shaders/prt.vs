@@ -0,0 +1,43 @@
+# version 450 core
+
+layout (location=0) in vec3 position;
+// transfer coefficients 0-2, 3-5 and 6-8, see RadianceTransfer
+layout (location=5) in vec3 transfer0;
+layout (location=6) in vec3 transfer1;
+layout (location=7) in vec3 transfer2;
+
+out vec3 radiance;
+
+uniform mat4 WVP;
+// the environment on the same basis, see SkyBox::projectSH
+uniform vec3 environmentSH[9];
+uniform int AOType;
+
+invariant gl_Position;
+
+const float pi = 3.14159265;
+// projection of constant light 1 onto Y00
+const float constantSH = 3.5449077;
+
+// Precomputed radiance transfer: the shadowed irradiance is the dot
+// product of the vertex's transfer with the environment, per channel.
+void main()
+{
+    gl_Position = WVP * vec4(position, 1.0);
+    float transfer[9] = float[](
+        transfer0.x, transfer0.y, transfer0.z,
+        transfer1.x, transfer1.y, transfer1.z,
+        transfer2.x, transfer2.y, transfer2.z);
+    if (AOType == 0)
+    {
+        vec3 irradiance = vec3(0.0);
+        for (int l = 0; l < 9; ++l)
+            irradiance += transfer[l] * environmentSH[l];
+        // ssdo.fs estimates irradiance / (4 pi): 0.5 times the uniform
+        // hemisphere average of the cosine-weighted light
+        radiance = max(irradiance, vec3(0.0)) / (4.0 * pi);
+    }
+    else
+        // cosine-weighted visibility, the transfer against constant light over pi
+        radiance = vec3(transfer[0] * constantSH / pi);
+}
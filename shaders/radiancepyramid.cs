@@ -0,0 +1,79 @@
+# version 450 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (rgba16f, binding = 0) uniform readonly image2D srcRadiance;
+layout (rgba32f, binding = 1) uniform readonly image2D srcPosition;
+layout (rgba16f, binding = 2) uniform readonly image2D srcNormal;
+layout (rgba16f, binding = 3) uniform writeonly image2D dstRadiance;
+layout (rgba32f, binding = 4) uniform writeonly image2D dstPosition;
+layout (rgba16f, binding = 5) uniform writeonly image2D dstNormal;
+
+#include "gbuffer.glsl"
+
+uniform int level;
+uniform vec3 lightPos;
+uniform mat4 viewMat;
+uniform vec3 lightDiffuse;
+
+// Level 0 is the directly lit surface: albedo * diffuse light * shadow, with
+// its view-space position and normal. Every other level averages the covered
+// texels of the 2x2 below it (plus the extra row/column of odd sizes), so a
+// texel describes the whole patch it covers; alpha/w keep the covered fraction.
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, imageSize(dstRadiance))))
+        return;
+
+    if (level == 0)
+    {
+        vec4 fragPos = loadPosition(texel);
+        if (fragPos.w == 0.0)
+        {
+            imageStore(dstRadiance, texel, vec4(0.0));
+            imageStore(dstPosition, texel, vec4(0.0));
+            imageStore(dstNormal, texel, vec4(0.0));
+            return;
+        }
+        vec2 uv = (vec2(texel) + 0.5) / vec2(imageSize(dstRadiance));
+        vec3 normal = loadNormal(texel);
+        vec3 lightVec = normalize((viewMat * vec4(lightPos, 1.0)).xyz - fragPos.xyz);
+        vec3 albedo = texelFetch(textureAlbedo, texel, 0).rgb;
+        vec3 radiance = albedo * lightDiffuse * max(dot(normal, lightVec), 0.0) * readShadow(uv);
+        imageStore(dstRadiance, texel, vec4(radiance, 1.0));
+        imageStore(dstPosition, texel, fragPos);
+        imageStore(dstNormal, texel, vec4(normal, 1.0));
+        return;
+    }
+
+    ivec2 srcSize = imageSize(srcRadiance);
+    ivec2 base = texel * 2;
+    ivec2 last = min(base + 1 + (srcSize & 1) * ivec2(equal(texel, imageSize(dstRadiance) - 1)), srcSize - 1);
+    vec3 radiance = vec3(0.0);
+    vec3 position = vec3(0.0);
+    vec3 normal = vec3(0.0);
+    float coverage = 0.0;
+    float count = 0.0;
+    for (int y = base.y; y <= last.y; ++y)
+        for (int x = base.x; x <= last.x; ++x)
+        {
+            vec4 r = imageLoad(srcRadiance, ivec2(x, y));
+            radiance += r.rgb * r.a;
+            position += imageLoad(srcPosition, ivec2(x, y)).xyz * r.a;
+            normal += imageLoad(srcNormal, ivec2(x, y)).xyz * r.a;
+            coverage += r.a;
+            count += 1.0;
+        }
+    if (coverage == 0.0)
+    {
+        imageStore(dstRadiance, texel, vec4(0.0));
+        imageStore(dstPosition, texel, vec4(0.0));
+        imageStore(dstNormal, texel, vec4(0.0));
+        return;
+    }
+    imageStore(dstRadiance, texel, vec4(radiance / coverage, coverage / count));
+    imageStore(dstPosition, texel, vec4(position / coverage, coverage / count));
+    // left unnormalized, a short normal marks a patch that is not flat
+    imageStore(dstNormal, texel, vec4(normal / coverage, coverage / count));
+}
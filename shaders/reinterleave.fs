@@ -0,0 +1,17 @@
+# version 450 core
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 outDirect;
+layout (location = 1) out vec4 outIndirect;
+
+uniform sampler2DArray layerDirect;
+uniform sampler2DArray layerIndirect;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec3 src = ivec3(pixel / 4, (pixel.y % 4) * 4 + pixel.x % 4);
+    outDirect = texelFetch(layerDirect, src, 0);
+    outIndirect = texelFetch(layerIndirect, src, 0);
+}
@@ -0,0 +1,92 @@
+// Weighted reservoirs of environment directions for ReSTIR direct lighting
+// (Bitterli et al. 2020), shared by restir.fs and restirspatial.fs. Needs
+// gbuffer.glsl and environment.glsl included first.
+//
+// A reservoir texel is RGBA32F: octahedral world direction (rg), unbiased
+// contribution weight W (b) and candidate count M (a).
+
+struct Reservoir
+{
+    vec3 dir;
+    float wSum;
+    float W;
+    float M;
+};
+
+// radius and depth test of the kernel loop in ssdo.fs
+const float visibilityRadius = 0.01;
+const float visibilityBias = 0.000;
+
+Reservoir emptyReservoir()
+{
+    return Reservoir(vec3(0.0, 1.0, 0.0), 0.0, 0.0, 0.0);
+}
+Reservoir decodeReservoir(vec4 texel)
+{
+    return Reservoir(decodeNormal(texel.rg), 0.0, texel.b, texel.a);
+}
+vec4 encodeReservoir(Reservoir r)
+{
+    return vec4(encodeNormal(r.dir), r.W, r.M);
+}
+
+uint rngState;
+void seedRandom(ivec2 pixel, int frame)
+{
+    rngState = uint(pixel.x) * 1973u + uint(pixel.y) * 9277u + uint(frame) * 26699u;
+}
+float random()
+{
+    // PCG hash
+    rngState = rngState * 747796405u + 2891336453u;
+    uint word = ((rngState >> ((rngState >> 28u) + 4u)) ^ rngState) * 277803737u;
+    return float((word >> 22u) ^ word) / 4294967296.0;
+}
+
+// view-space direction of world direction dir, flipped like Illuminance
+vec3 viewDirection(vec3 dir)
+{
+    return -(transpose(invViewRot) * dir);
+}
+// unshadowed contribution, the target function every reservoir resamples to
+float targetPdf(vec3 dir, vec3 normal)
+{
+    float cosTheta = dot(normal, viewDirection(dir));
+    if (cosTheta <= 0.0)
+        return 0.0;
+    return dot(HDRRadiance(dir), vec3(0.2126, 0.7152, 0.0722)) * cosTheta;
+}
+
+bool updateReservoir(inout Reservoir r, vec3 dir, float weight, float count)
+{
+    r.wSum += weight;
+    r.M += count;
+    if (weight > 0.0 && random() * r.wSum < weight)
+    {
+        r.dir = dir;
+        return true;
+    }
+    return false;
+}
+// merges other, whose W was computed elsewhere, as seen from this pixel
+void combineReservoir(inout Reservoir r, Reservoir other, vec3 normal)
+{
+    updateReservoir(r, other.dir, targetPdf(other.dir, normal) * other.W * other.M, other.M);
+}
+void finalizeReservoir(inout Reservoir r, vec3 normal)
+{
+    float pHat = targetPdf(r.dir, normal);
+    r.W = pHat > 0.0 && r.M > 0.0 ? r.wSum / (r.M * pHat) : 0.0;
+}
+
+// One visibility test along view-space direction dir: the single-point
+// depth test of the kernel loop in ssdo.fs, so the result matches its term.
+float visibility(vec3 fragPos, vec3 dir)
+{
+    vec3 s = fragPos + dir * visibilityRadius * 0.5;
+    vec4 offset = projMat * vec4(s, 1.0);
+    offset.xy = offset.xy / offset.w * 0.5 + 0.5;
+    float sampleDepth = readPosition(offset.xy).z;
+    float rangeCheck = smoothstep(0.0, 1.0, visibilityRadius / abs(fragPos.z - sampleDepth));
+    return sampleDepth >= s.z + visibilityBias ? rangeCheck : 0.0;
+}
@@ -0,0 +1,121 @@
+# version 450 core
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 outNormal;
+layout (location = 1) out vec4 outAlbedo;
+
+#include "gbuffer.glsl"
+
+// Position, attribute and index buffers of the mesh being resolved,
+// see Mesh::setup and VertexAttributes in src/scene.h
+layout (std430, binding = 1) readonly buffer PositionBuffer
+{
+    float positionData[];
+};
+layout (std430, binding = 2) readonly buffer IndexBuffer
+{
+    uint indexData[];
+};
+layout (std430, binding = 3) readonly buffer AttributeBuffer
+{
+    float attributeData[];
+};
+const int attributeStride = 11;
+const int normalOffset = 0;
+const int texCoordOffset = 3;
+const int tangentOffset = 5;
+const int bitangentOffset = 8;
+
+uniform usampler2D textureVisibility;
+uniform sampler2D textureDiffuse;
+uniform sampler2D textureNormals;
+uniform sampler2D textureShadow;
+
+uniform uint drawID;
+uniform mat4 modelMat;
+uniform mat4 WVP;
+uniform mat4 lightMat;
+uniform vec3 lightDir;
+uniform float shininess;
+
+vec3 readVertexPosition(uint vertex)
+{
+    int base = int(vertex) * 3;
+    return vec3(positionData[base], positionData[base + 1], positionData[base + 2]);
+}
+vec3 readVec3(uint vertex, int offset)
+{
+    int base = int(vertex) * attributeStride + offset;
+    return vec3(attributeData[base], attributeData[base + 1], attributeData[base + 2]);
+}
+vec2 readVec2(uint vertex, int offset)
+{
+    int base = int(vertex) * attributeStride + offset;
+    return vec2(attributeData[base], attributeData[base + 1]);
+}
+
+// Perspective-correct barycentrics of the NDC point p in the triangle
+// with clip-space corners c0, c1, c2.
+vec3 barycentrics(vec4 c0, vec4 c1, vec4 c2, vec2 p)
+{
+    vec3 invW = 1.0 / vec3(c0.w, c1.w, c2.w);
+    vec2 p0 = c0.xy * invW.x;
+    vec2 e1 = c1.xy * invW.y - p0;
+    vec2 e2 = c2.xy * invW.z - p0;
+    vec2 d = p - p0;
+    float det = e1.x * e2.y - e1.y * e2.x;
+    float b1 = (d.x * e2.y - d.y * e2.x) / det;
+    float b2 = (e1.x * d.y - e1.y * d.x) / det;
+    vec3 b = vec3(1.0 - b1 - b2, b1, b2) * invW;
+    return b / (b.x + b.y + b.z);
+}
+
+// Material shading of geometry.fs for the one triangle the visibility
+// buffer kept at this pixel; pixels of other draws are left to their pass.
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uint id = texelFetch(textureVisibility, pixel, 0).r;
+    if (id == 0xffffffffu || (id >> 24) != drawID)
+        discard;
+
+    uint primitive = id & 0xffffffu;
+    uint i0 = indexData[primitive * 3u];
+    uint i1 = indexData[primitive * 3u + 1u];
+    uint i2 = indexData[primitive * 3u + 2u];
+    mat3 positions = mat3(readVertexPosition(i0), readVertexPosition(i1), readVertexPosition(i2));
+
+    // barycentrics at this pixel and its right/upper neighbours give the
+    // texture coordinate derivatives the rasterizer would have produced
+    vec4 c0 = WVP * vec4(positions[0], 1.0);
+    vec4 c1 = WVP * vec4(positions[1], 1.0);
+    vec4 c2 = WVP * vec4(positions[2], 1.0);
+    vec2 pixelSize = 2.0 / vec2(textureSize(textureVisibility, 0));
+    vec2 p = (vec2(pixel) + 0.5) * pixelSize - 1.0;
+    vec3 b = barycentrics(c0, c1, c2, p);
+    vec3 bx = barycentrics(c0, c1, c2, p + vec2(pixelSize.x, 0.0));
+    vec3 by = barycentrics(c0, c1, c2, p + vec2(0.0, pixelSize.y));
+
+    mat3x2 texCoords = mat3x2(readVec2(i0, texCoordOffset), readVec2(i1, texCoordOffset), readVec2(i2, texCoordOffset));
+    vec2 uv = texCoords * b;
+    vec2 uvDx = texCoords * bx - uv;
+    vec2 uvDy = texCoords * by - uv;
+
+    mat3 model = mat3(modelMat);
+    vec3 T = normalize(model * (mat3(readVec3(i0, tangentOffset), readVec3(i1, tangentOffset), readVec3(i2, tangentOffset)) * b));
+    vec3 B = normalize(model * (mat3(readVec3(i0, bitangentOffset), readVec3(i1, bitangentOffset), readVec3(i2, bitangentOffset)) * b));
+    vec3 N = normalize(model * (mat3(readVec3(i0, normalOffset), readVec3(i1, normalOffset), readVec3(i2, normalOffset)) * b));
+    mat3 TBN = mat3(T, B, N);
+
+    vec3 norm = normalize(TBN * (textureGrad(textureNormals, uv, uvDx, uvDy).rgb * 2.0 - 1.0));
+    outAlbedo = vec4(textureGrad(textureDiffuse, uv, uvDx, uvDy).rgb, 1.0);
+
+    vec4 lightSpacePos = lightMat * modelMat * vec4(positions * b, 1.0);
+    vec3 light = lightSpacePos.xyz / lightSpacePos.w;
+    vec3 shadowPos = light * 0.5 + 0.5;
+
+    float bias = max(0.0005 * (1.0 - dot(norm, normalize(lightDir))), 0.0);
+    float lighted = shadowPos.z > 1.0 ? 1.0 : step(shadowPos.z, texture(textureShadow, shadowPos.xy).r + bias);
+    outNormal = vec4(encodeNormal(norm), shininess / 10.0, lighted);
+}
@@ -0,0 +1,78 @@
+# version 450 core
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 outReservoir;
+layout (location = 1) out vec4 outGeometry;
+
+#include "gbuffer.glsl"
+
+uniform mat4 projMat;
+
+#include "environment.glsl"
+#include "reservoir.glsl"
+
+// last frame's reservoirs after spatial reuse, and the normal / view z they
+// were computed for
+uniform sampler2D prevReservoir;
+uniform sampler2D prevGeometry;
+// current view space to the previous frame's view space
+uniform mat4 toPrevView;
+uniform int frame;
+uniform int reset;
+
+const int candidateCount = 8;
+// temporal history is capped at this many times the fresh candidates
+const float maxHistory = 20.0;
+const float depthTolerance = 0.02;
+const float normalTolerance = 0.9;
+
+// Initial candidates from the importance-sampled environment pool resampled
+// to the unshadowed target, the survivor visibility-tested once, then merged
+// with the reprojected reservoir of the previous frame.
+void main()
+{
+    vec4 fragPos = readPosition(texCoord);
+    vec3 normal = readNormal(texCoord);
+    outGeometry = vec4(normal, fragPos.z);
+    if (fragPos.w == 0.0)
+    {
+        outReservoir = encodeReservoir(emptyReservoir());
+        return;
+    }
+    seedRandom(ivec2(gl_FragCoord.xy), frame);
+
+    Reservoir r = emptyReservoir();
+    for (int i = 0; i < candidateCount; ++i)
+    {
+        vec4 envSample = envSamples[min(int(random() * float(envPoolSize)), envPoolSize - 1)];
+        updateReservoir(r, envSample.xyz, targetPdf(envSample.xyz, normal) / envSample.w, 1.0);
+    }
+    finalizeReservoir(r, normal);
+    // visibility reuse: an occluded survivor keeps its M but no weight
+    if (r.W > 0.0 && visibility(fragPos.xyz, viewDirection(r.dir)) == 0.0)
+        r.W = 0.0;
+
+    if (reset == 0)
+    {
+        vec4 prevPos = toPrevView * vec4(fragPos.xyz, 1.0);
+        vec4 prevClip = projMat * prevPos;
+        vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+        if (all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0))))
+        {
+            vec4 geometry = texture(prevGeometry, prevUV);
+            float depthError = abs(geometry.w - prevPos.z) / max(abs(prevPos.z), 1e-3);
+            if (depthError < depthTolerance && dot(geometry.xyz, normal) > normalTolerance)
+            {
+                Reservoir prev = decodeReservoir(texture(prevReservoir, prevUV));
+                prev.M = min(prev.M, maxHistory * float(candidateCount));
+                Reservoir merged = emptyReservoir();
+                combineReservoir(merged, r, normal);
+                combineReservoir(merged, prev, normal);
+                finalizeReservoir(merged, normal);
+                r = merged;
+            }
+        }
+    }
+    outReservoir = encodeReservoir(r);
+}
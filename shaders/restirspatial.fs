@@ -0,0 +1,63 @@
+# version 450 core
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 outDirect;
+layout (location = 1) out vec4 outReservoir;
+
+#include "gbuffer.glsl"
+
+uniform mat4 projMat;
+
+#include "environment.glsl"
+#include "reservoir.glsl"
+
+// reservoirs after restir.fs
+uniform sampler2D textureReservoir;
+uniform int frame;
+
+const int neighbourCount = 4;
+const float neighbourRadius = 16.0;
+const float depthTolerance = 0.1;
+const float normalTolerance = 0.9;
+
+// Merges the reservoirs of a few nearby pixels on similar surfaces, keeps
+// the result for next frame's temporal reuse and shades with it: one more
+// visibility test, the same estimate of the kernel loop's direct term as
+// envSampledIlluminance in ssdo.fs.
+void main()
+{
+    vec4 fragPos = readPosition(texCoord);
+    if (fragPos.w == 0.0)
+    {
+        outDirect = vec4(0.0);
+        outReservoir = encodeReservoir(emptyReservoir());
+        return;
+    }
+    vec3 normal = readNormal(texCoord);
+    // a different stream than restir.fs used this frame
+    seedRandom(ivec2(gl_FragCoord.xy), frame + 7919);
+
+    vec2 texelSize = 1.0 / vec2(textureSize(textureReservoir, 0));
+    Reservoir r = emptyReservoir();
+    combineReservoir(r, decodeReservoir(texture(textureReservoir, texCoord)), normal);
+    for (int i = 0; i < neighbourCount; ++i)
+    {
+        float angle = random() * twoPi;
+        float offsetLength = sqrt(random()) * neighbourRadius;
+        vec2 uv = texCoord + vec2(cos(angle), sin(angle)) * offsetLength * texelSize;
+        vec4 neighbourPos = readPosition(uv);
+        if (neighbourPos.w == 0.0 ||
+            abs(neighbourPos.z - fragPos.z) > depthTolerance * abs(fragPos.z) ||
+            dot(readNormal(uv), normal) < normalTolerance)
+            continue;
+        combineReservoir(r, decodeReservoir(texture(textureReservoir, uv)), normal);
+    }
+    finalizeReservoir(r, normal);
+    outReservoir = encodeReservoir(r);
+
+    vec3 dir = viewDirection(r.dir);
+    float cosTheta = max(dot(normal, dir), 0.0);
+    vec3 direct = HDRRadiance(r.dir) * cosTheta * visibility(fragPos.xyz, dir) * 0.5 / twoPi * r.W;
+    outDirect = vec4(direct, 1.0);
+}
@@ -0,0 +1,152 @@
+# version 450 core
+
+in vec2 texCoord;
+
+out vec4 fragColor;
+
+#include "gbuffer.glsl"
+
+uniform sampler2D textureNoise;
+// the baked distance fields of all meshes, one slab of slabDepth along z each
+uniform sampler3D textureDistanceField;
+uniform float slabDepth;
+
+// One placement of a baked mesh, see SSDORenderer::sdfAOPass
+struct DistanceFieldInstance
+{
+    mat4 viewToLocal;
+    // w: atlas z coordinate where the mesh's slab starts
+    vec4 boxMin;
+    // w: local to view distance scale
+    vec4 boxMax;
+};
+const int maxInstances = 64;
+layout (std140, binding = 2) uniform DistanceFieldInstances
+{
+    DistanceFieldInstance instances[maxInstances];
+};
+uniform int instanceCount;
+
+uniform int AOType;
+// view-space lengths, a few voxels and a few dozen voxels of the fields
+uniform float startOffset;
+uniform float traceDistance;
+
+const int coneCount = 6;
+const int stepCount = 12;
+// cone half-angle of about 33 degrees, six of them cover the hemisphere
+const float coneTan = 0.65;
+const float coneAperture = 0.576;
+// tangent space: one along the normal, five at 60 degrees from it
+const vec3 cones[coneCount] = vec3[](
+    vec3(0.0, 0.0, 1.0),
+    vec3(0.866025, 0.0, 0.5),
+    vec3(0.267617, 0.823639, 0.5),
+    vec3(-0.700629, 0.509037, 0.5),
+    vec3(-0.700629, -0.509037, 0.5),
+    vec3(0.267617, -0.823639, 0.5));
+
+#include "environment.glsl"
+
+// Bit i is set when instance i's box comes within traceDistance of the
+// sphere every cone of this pixel stays in, so sceneDistance only visits
+// the instances that can occlude it.
+uvec2 nearbyInstances(vec3 origin)
+{
+    uvec2 nearby = uvec2(0u);
+    for (int i = 0; i < instanceCount; ++i)
+    {
+        vec3 local = (instances[i].viewToLocal * vec4(origin, 1.0)).xyz;
+        vec3 inside = clamp(local, instances[i].boxMin.xyz, instances[i].boxMax.xyz);
+        if (length(local - inside) * instances[i].boxMax.w < 2.0 * traceDistance)
+            nearby[i >> 5] |= 1u << (i & 31);
+    }
+    return nearby;
+}
+
+// Distance from view-space p to the nearest nearby instance, at most
+// traceDistance. Outside an instance's box the distance to the box is added
+// to the field at the box surface, and boxes farther than the current
+// minimum are skipped.
+float sceneDistance(vec3 p, uvec2 nearby)
+{
+    float res = float(textureSize(textureDistanceField, 0).x);
+    float nearest = traceDistance;
+    for (int word = 0; word < 2; ++word)
+    {
+        uint bits = nearby[word];
+        while (bits != 0u)
+        {
+            int bit = findLSB(bits);
+            bits &= bits - 1u;
+            int i = word * 32 + bit;
+            vec3 local = (instances[i].viewToLocal * vec4(p, 1.0)).xyz;
+            vec3 boxMin = instances[i].boxMin.xyz;
+            vec3 boxMax = instances[i].boxMax.xyz;
+            float scale = instances[i].boxMax.w;
+            vec3 inside = clamp(local, boxMin, boxMax);
+            float boxDistance = length(local - inside) * scale;
+            if (boxDistance >= nearest)
+                continue;
+            // keep the filter footprint inside the slab
+            vec3 uvw = clamp((inside - boxMin) / (boxMax - boxMin), 0.5 / res, 1.0 - 0.5 / res);
+            float d = texture(textureDistanceField, vec3(uvw.xy, instances[i].boxMin.w + uvw.z * slabDepth)).r;
+            nearest = min(nearest, boxDistance + d * scale);
+        }
+    }
+    return nearest;
+}
+
+// Sphere-traces along dir, the visibility is the narrowest opening
+// d / (t * coneTan) seen along the way (Quilez soft shadows). Every step
+// advances at least traceDistance / stepCount, so the cost is fixed.
+float coneVisibility(vec3 origin, vec3 dir, uvec2 nearby)
+{
+    float visibility = 1.0;
+    float t = startOffset;
+    for (int n = 0; n < stepCount && t < traceDistance; ++n)
+    {
+        float d = sceneDistance(origin + dir * t, nearby);
+        visibility = min(visibility, d / (t * coneTan));
+        if (visibility <= 0.0)
+            break;
+        t += max(d, traceDistance / float(stepCount));
+    }
+    return smoothstep(0.0, 1.0, clamp(visibility, 0.0, 1.0));
+}
+
+// Occlusion from the distance fields instead of the depth buffer, so
+// occluders off screen or behind the front surface still count. Same
+// outputs as ssdo.fs: environment light through the cones for SSDO, the
+// visibility for SSAO.
+void main()
+{
+    vec3 fragPos   = readPosition(texCoord).xyz;
+    vec3 normal    = readNormal(texCoord);
+    vec3 randomVec = texelFetch(textureNoise, ivec2(gl_FragCoord.xy) % textureSize(textureNoise, 0), 0).xyz;
+
+    vec3 tangent   = normalize(randomVec - normal * dot(randomVec, normal));
+    vec3 bitangent = cross(normal, tangent);
+    mat3 TBN       = mat3(tangent, bitangent, normal);
+
+    vec3 origin = fragPos + normal * startOffset;
+    uvec2 nearby = nearbyInstances(origin);
+    vec3 occlusion = vec3(0.0);
+    float weightSum = 0.0;
+    for (int n = 0; n < coneCount; ++n)
+    {
+        vec3 dir = TBN * cones[n];
+        float w = cones[n].z;
+        float visibility = coneVisibility(origin, dir, nearby);
+        if (AOType == 0)
+            occlusion += ConeIlluminance(dir, coneAperture) * visibility * w;
+        else
+            occlusion += vec3(visibility) * w;
+        weightSum += w;
+    }
+    occlusion /= weightSum;
+    // the kernel loop's 0.5 * E[cos] over the hemisphere, for constant light
+    if (AOType == 0)
+        occlusion *= 0.25;
+    fragColor = vec4(occlusion, 1.0);
+}
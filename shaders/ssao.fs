@@ -4,26 +4,22 @@ in vec2 texCoord;
 
 out float fragColor;
 
-uniform sampler2D texturePosition;
-uniform sampler2D textureNormal;
-uniform sampler2D textureAlbedo;
-uniform sampler2D textureLight;
+#include "gbuffer.glsl"
+
 uniform sampler2D textureNoise;
 
 uniform vec3 kernel[64];
 uniform mat4 projMat;
 
-const vec2 noiseScale = vec2(1600.0, 900.0) / 4.0;
-
 const float radius = 0.5;
 const float bias = 0.0;
 const float occPower = 2.0;
 
 void main()
 {
-    vec3 fragPos   = texture(texturePosition, texCoord).xyz;
-    vec3 normal    = texture(textureNormal, texCoord).rgb;
-    vec3 randomVec = texture(textureNoise, texCoord * noiseScale).xyz;
+    vec3 fragPos   = readPosition(texCoord).xyz;
+    vec3 normal    = readNormal(texCoord);
+    vec3 randomVec = texelFetch(textureNoise, ivec2(gl_FragCoord.xy) % textureSize(textureNoise, 0), 0).xyz;
 
     vec3 tangent   = normalize(randomVec - normal * dot(randomVec, normal));
     vec3 bitangent = cross(normal, tangent);
@@ -40,7 +36,7 @@ void main()
         offset.xyz /= offset.w;
         offset.xyz = offset.xyz * 0.5 + 0.5;
 
-        float sampleDepth = texture(texturePosition, offset.xy).z;
+        float sampleDepth = readPosition(offset.xy).z;
         float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
         occlusion += (sampleDepth >= s.z + bias ? 1.0 : 0.0) * rangeCheck;
     }
@@ -4,45 +4,114 @@ in vec2 texCoord;
 
 out vec4 fragColor;
 
-uniform sampler2D texturePosition;
-uniform sampler2D textureNormal;
-uniform sampler2D textureAlbedo;
-uniform sampler2D textureLight;
+#include "gbuffer.glsl"
+
 uniform sampler2D textureNoise;
-uniform samplerCube textureCubeMap;
+uniform sampler2D textureDepthPyramid;
 
 uniform vec3 kernel[64];
-uniform mat4 viewMat;
 uniform mat4 projMat;
 
-uniform int AOType;
+// a frame evaluates kernel[sampleOffset] .. kernel[sampleOffset + sampleCount - 1],
+// with the tangent frame rotated by rotation around the normal
+uniform int sampleCount;
+uniform int sampleOffset;
+uniform float rotation;
+
+// with depthPyramid set, sample depth comes from the mip of textureDepthPyramid
+// matching the sample's screen-space distance (Scalable Ambient Obscurance)
+uniform int depthPyramid;
+const int logMaxOffset = 3;
+const int maxMipLevel = 5;
 
-const vec2 noiseScale = vec2(1600.0, 900.0) / 4.0;
+uniform int AOType;
+// with bentNormal set, direct light is one prefiltered environment lookup
+// along the bent normal instead of one cubemap fetch per sample
+uniform int bentNormal;
+// with envSampling set, direct light uses envSampleCount directions of the
+// importance-sampled pool instead of the kernel
+uniform int envSampling;
+uniform int envSampleCount;
 
 const float radius = 0.01;
 const float bias = 0.000;
 
-vec3 Illuminance(vec3 v)
+#include "environment.glsl"
+#include "adaptive.glsl"
+
+float sampleDepthAt(vec2 uv)
 {
-    vec3 dir = inverse(mat3(viewMat)) * -v;
-    vec3 hdr = texture(textureCubeMap, dir.xyz).rgb;
-    return hdr;
+    if (depthPyramid == 1)
+    {
+        float ssR = length((uv - texCoord) * vec2(textureSize(textureDepthPyramid, 0)));
+        int level = clamp(findMSB(int(ssR)) - logMaxOffset, 0, maxMipLevel);
+        return textureLod(textureDepthPyramid, uv, float(level)).r;
+    }
+    return readPosition(uv).z;
+}
+
+// Monte Carlo estimate of the kernel loop's direct term with directions
+// drawn in proportion to the environment radiance. Every pixel of a 4x4
+// block takes its own slice of the pool, so the blur averages 16 slices.
+vec3 envSampledIlluminance(vec3 fragPos, vec3 normal)
+{
+    mat3 viewRot = transpose(invViewRot);
+    ivec2 block = ivec2(gl_FragCoord.xy) % 4;
+    int first = (block.y * 4 + block.x) * envSampleCount;
+    vec3 occlusion = vec3(0.0);
+    for (int n = 0; n < envSampleCount; ++n)
+    {
+        vec4 envSample = envSamples[(first + n) % envPoolSize];
+        // view-space direction, flipped like Illuminance
+        vec3 dir = -(viewRot * envSample.xyz);
+        float cosTheta = dot(normal, dir);
+        if (cosTheta <= 0.0)
+            continue;
+        float scale = (float(n) + 0.5) / float(envSampleCount);
+        vec3 s = fragPos + dir * (0.1 + 0.9 * scale * scale) * radius;
+        vec4 offset = projMat * vec4(s, 1.0);
+        offset.xyz /= offset.w;
+        offset.xyz = offset.xyz * 0.5 + 0.5;
+
+        float sampleDepth = sampleDepthAt(offset.xy);
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+        // same test and weight as the kernel loop, divided by the pdf
+        // relative to the uniform hemisphere the kernel approximates
+        if (sampleDepth >= s.z + bias)
+            occlusion += HDRRadiance(envSample.xyz) * cosTheta * rangeCheck * 0.5 / (twoPi * envSample.w);
+    }
+    return occlusion / float(envSampleCount);
 }
 
 void main()
 {
-    vec3 fragPos   = texture(texturePosition, texCoord).xyz;
-    vec3 normal    = texture(textureNormal, texCoord).rgb;
-    vec3 randomVec = texture(textureNoise, texCoord * noiseScale).xyz;
+    vec3 fragPos   = readPosition(texCoord).xyz;
+    vec3 normal    = readNormal(texCoord);
+    vec3 randomVec = texelFetch(textureNoise, ivec2(gl_FragCoord.xy) % textureSize(textureNoise, 0), 0).xyz;
 
     vec3 tangent   = normalize(randomVec - normal * dot(randomVec, normal));
     vec3 bitangent = cross(normal, tangent);
+    tangent        = cos(rotation) * tangent + sin(rotation) * bitangent;
+    bitangent      = cross(normal, tangent);
     mat3 TBN       = mat3(tangent, bitangent, normal);
 
+    if (AOType == 0 && envSampling == 1)
+    {
+        fragColor = vec4(envSampledIlluminance(fragPos, normal), 1.0);
+        recordSamples(0, envSampleCount);
+        return;
+    }
+
     vec3 occlusion = vec3(0.0);
-    for(int i = 0; i < 64; ++i)
+    vec3 bent = vec3(0.0);
+    float bentWeight = 0.0;
+    int cap = adaptiveCap(sampleCount);
+    int taken = 0;
+    float visibilitySum = 0.0;
+    float visibilitySumSq = 0.0;
+    for(int n = 0; n < cap; ++n)
     {
-        vec3 dir = TBN * kernel[i];
+        vec3 dir = TBN * kernel[(sampleOffset + adaptiveIndex(n, sampleCount)) % 64];
         vec3 s = fragPos + dir * radius;
         vec4 offset = vec4(s, 1.0);
 
@@ -50,18 +119,37 @@ void main()
         offset.xyz /= offset.w;
         offset.xyz = offset.xyz * 0.5 + 0.5;
 
-        float sampleDepth = texture(texturePosition, offset.xy).z;
+        float sampleDepth = sampleDepthAt(offset.xy);
         float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
         if (AOType == 0)
         {
             if (sampleDepth >= s.z + bias)
-                occlusion += Illuminance(dir) * dot(normal, normalize(dir)) * rangeCheck * 0.5;
+            {
+                float w = dot(normal, normalize(dir)) * rangeCheck * 0.5;
+                if (bentNormal == 1)
+                {
+                    bent += normalize(dir) * w;
+                    bentWeight += w;
+                }
+                else
+                    occlusion += Illuminance(dir) * w;
+            }
         } else
         if (AOType == 1)
             occlusion += vec3(sampleDepth >= s.z + bias ? 1.0 : 0.0) * rangeCheck;
         else if (AOType == 2)
             occlusion += vec3(1.0);
+
+        float visibility = sampleDepth >= s.z + bias ? rangeCheck : 0.0;
+        visibilitySum += visibility;
+        visibilitySumSq += visibility * visibility;
+        taken = n + 1;
+        if (adaptiveDone(taken, visibilitySum, visibilitySumSq))
+            break;
     }
-    occlusion = (occlusion / 64.0);
+    recordSamples(0, taken);
+    if (AOType == 0 && bentNormal == 1)
+        occlusion = BentNormalIlluminance(bent, bentWeight);
+    occlusion = (occlusion / float(taken));
     fragColor = vec4(occlusion, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+# version 450 core
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 outDirect;
+layout (location = 1) out vec4 outIndirect;
+layout (location = 2) out vec4 outGeometry;
+
+#include "gbuffer.glsl"
+
+uniform sampler2D textureDirect;
+uniform sampler2D textureIndirect;
+uniform sampler2D historyDirect;
+uniform sampler2D historyIndirect;
+uniform sampler2D historyGeometry;
+
+uniform mat4 invViewMat;
+uniform mat4 prevViewMat;
+uniform mat4 projMat;
+uniform int reset;
+
+// history length is kept in the alpha channel of the direct term
+const float maxHistory = 8.0;
+const float depthTolerance = 0.02;
+const float normalTolerance = 0.9;
+
+void main()
+{
+    vec4 fragPos = readPosition(texCoord);
+    vec3 normal = readNormal(texCoord);
+    vec3 direct = texture(textureDirect, texCoord).rgb;
+    vec3 indirect = texture(textureIndirect, texCoord).rgb;
+    outGeometry = vec4(normal, fragPos.z);
+
+    float history = 0.0;
+    vec3 prevDirect = vec3(0.0);
+    vec3 prevIndirect = vec3(0.0);
+    if (reset == 0 && fragPos.w != 0.0)
+    {
+        vec4 prevPos = prevViewMat * invViewMat * vec4(fragPos.xyz, 1.0);
+        vec4 prevClip = projMat * prevPos;
+        vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+        // behind the previous camera the divide mirrors the point on screen
+        if (prevClip.w > 0.0 &&
+            all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0))))
+        {
+            // disocclusion: the surface seen there last frame must be this one
+            vec4 prevGeometry = texture(historyGeometry, prevUV);
+            float depthError = abs(prevGeometry.w - prevPos.z) / max(abs(prevPos.z), 1e-3);
+            if (depthError < depthTolerance && dot(prevGeometry.xyz, normal) > normalTolerance)
+            {
+                vec4 prev = texture(historyDirect, prevUV);
+                prevDirect = prev.rgb;
+                prevIndirect = texture(historyIndirect, prevUV).rgb;
+                history = prev.a;
+            }
+        }
+    }
+
+    float count = min(history + 1.0, maxHistory);
+    outDirect = vec4(mix(prevDirect, direct, 1.0 / count), count);
+    outIndirect = vec4(mix(prevIndirect, indirect, 1.0 / count), 1.0);
+}
@@ -0,0 +1,136 @@
+# version 450 core
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (rgba8, binding = 0) uniform writeonly image2D imageDirect;
+layout (rgba8, binding = 1) uniform writeonly image2D imageIndirect;
+
+#include "gbuffer.glsl"
+
+uniform sampler2D textureNoise;
+
+uniform vec3 kernel[64];
+uniform mat4 projMat;
+
+// a frame evaluates kernel[sampleOffset] .. kernel[sampleOffset + sampleCount - 1],
+// with the tangent frame rotated by rotation around the normal
+uniform int sampleCount;
+uniform int sampleOffset;
+uniform float rotation;
+
+uniform int AOType;
+uniform float radius;
+
+const float bias = 0.000;
+const float area = 10;
+
+// The tile plus an apron on every side is cached in shared memory,
+// normals and albedo packed to 32 bits: 32 * 32 * 24 bytes = 24KB.
+const int tileSize = 16;
+const int apron = 8;
+const int cacheSize = tileSize + 2 * apron;
+
+shared vec4 cachePosition[cacheSize * cacheSize];
+shared uint cacheNormal[cacheSize * cacheSize];
+shared uint cacheAlbedo[cacheSize * cacheSize];
+
+ivec2 screenSize;
+ivec2 cacheOrigin;
+
+int cacheIndex(ivec2 p)
+{
+    ivec2 local = p - cacheOrigin;
+    if (any(lessThan(p, ivec2(0))) || any(greaterThanEqual(p, screenSize)) ||
+        any(lessThan(local, ivec2(0))) || any(greaterThanEqual(local, ivec2(cacheSize))))
+        return -1;
+    return local.y * cacheSize + local.x;
+}
+
+vec4 fetchPosition(vec2 uv, int idx)
+{
+    return idx >= 0 ? cachePosition[idx] : readPosition(uv);
+}
+vec3 fetchNormal(vec2 uv, int idx)
+{
+    return idx >= 0 ? unpackSnorm4x8(cacheNormal[idx]).xyz : readNormal(uv);
+}
+vec3 fetchAlbedo(vec2 uv, int idx)
+{
+    return idx >= 0 ? unpackUnorm4x8(cacheAlbedo[idx]).rgb : texture(textureAlbedo, uv).rgb;
+}
+
+#include "environment.glsl"
+
+// Same computation as fused.fs, with G-buffer reads served from the tile
+// cache whenever a sample lands inside it.
+void main()
+{
+    screenSize = textureSize(textureDepth, 0);
+    cacheOrigin = ivec2(gl_WorkGroupID.xy) * tileSize - apron;
+
+    for (int i = int(gl_LocalInvocationIndex); i < cacheSize * cacheSize; i += tileSize * tileSize)
+    {
+        ivec2 p = clamp(cacheOrigin + ivec2(i % cacheSize, i / cacheSize), ivec2(0), screenSize - 1);
+        cachePosition[i] = loadPosition(p);
+        cacheNormal[i] = packSnorm4x8(vec4(loadNormal(p), 0.0));
+        cacheAlbedo[i] = packUnorm4x8(texelFetch(textureAlbedo, p, 0));
+    }
+    barrier();
+
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, screenSize)))
+        return;
+
+    int centerIdx = cacheIndex(pixel);
+    // background, its result is never read
+    if (cachePosition[centerIdx].w == 0.0)
+        return;
+    vec3 fragPos   = cachePosition[centerIdx].xyz;
+    vec3 normal    = loadNormal(pixel);
+    vec3 randomVec = texelFetch(textureNoise, pixel % textureSize(textureNoise, 0), 0).xyz;
+
+    vec3 tangent   = normalize(randomVec - normal * dot(randomVec, normal));
+    vec3 bitangent = cross(normal, tangent);
+    tangent        = cos(rotation) * tangent + sin(rotation) * bitangent;
+    bitangent      = cross(normal, tangent);
+    mat3 TBN       = mat3(tangent, bitangent, normal);
+
+    vec3 occlusion = vec3(0.0);
+    vec3 bounce = vec3(0.0);
+    for(int n = 0; n < sampleCount; ++n)
+    {
+        vec3 dir = TBN * kernel[(sampleOffset + n) % 64];
+        vec3 s = fragPos + dir * radius;
+        vec4 offset = vec4(s, 1.0);
+
+        offset = projMat * offset;
+        offset.xyz /= offset.w;
+        offset.xyz = offset.xyz * 0.5 + 0.5;
+
+        int idx = cacheIndex(ivec2(floor(offset.xy * vec2(screenSize))));
+        float sampleDepth = fetchPosition(offset.xy, idx).z;
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+        if (AOType == 0)
+        {
+            if (sampleDepth >= s.z + bias)
+                occlusion += Illuminance(dir) * dot(normal, normalize(dir)) * rangeCheck * 0.5;
+        } else
+        if (AOType == 1)
+            occlusion += vec3(sampleDepth >= s.z + bias ? 1.0 : 0.0) * rangeCheck;
+        else if (AOType == 2)
+            occlusion += vec3(1.0);
+
+        vec3 Snorm = fetchNormal(offset.xy, idx);
+        vec3 SR = normalize(fragPos-s);
+        float thetaS = dot(Snorm, SR);
+        if (sampleDepth < s.z + bias && abs(sampleDepth-s.z) < 0.5 && thetaS > 0.0)
+        {
+            vec3 sampleColor = fetchAlbedo(offset.xy, idx);
+            float dis = max(1.0, length(s - fragPos));
+            float thetaR = abs(dot(normal, SR));
+            bounce += sampleColor * area * thetaS * thetaR / dis / dis;
+        }
+    }
+    imageStore(imageDirect, pixel, vec4(occlusion / float(sampleCount), 1.0));
+    imageStore(imageIndirect, pixel, vec4(bounce / float(sampleCount), 1.0));
+}
@@ -0,0 +1,11 @@
+# version 450 core
+
+layout (location = 0) out uint outID;
+
+// draw index in the high 8 bits, triangle index in the low 24 bits
+uniform uint drawID;
+
+void main()
+{
+    outID = (drawID << 24) | uint(gl_PrimitiveID);
+}
@@ -0,0 +1,13 @@
+# version 450 core
+
+layout (location=0) in vec3 position;
+
+uniform mat4 WVP;
+
+// the depth pre-pass and geometry.vs must produce bit-identical depth
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = WVP * vec4(position, 1.0);
+}
@@ -0,0 +1,32 @@
+# version 450 core
+
+in vec3 worldPos;
+in vec3 normal;
+in vec2 texCoord;
+
+uniform sampler2D textureDiffuse;
+
+uniform vec3 gridMin;
+uniform float gridSize;
+uniform int gridResolution;
+
+#include "directlight.glsl"
+#include "voxelsums.glsl"
+
+// The directly lit surface added to the sums of the voxel the fragment
+// falls in, along with one to its fragment count.
+void main()
+{
+    ivec3 res = ivec3(gridResolution);
+    ivec3 voxel = ivec3(floor((worldPos - gridMin) / gridSize * vec3(res)));
+    if (any(lessThan(voxel, ivec3(0))) || any(greaterThanEqual(voxel, res)))
+        return;
+    vec3 albedo = texture(textureDiffuse, texCoord).rgb;
+    vec3 radiance = min(LitRadiance(worldPos, normalize(normal), albedo), vec3(maxRadiance));
+    uvec3 fixedPoint = uvec3(round(radiance * sumScale));
+    uint base = voxelSumIndex(voxel, res);
+    atomicAdd(voxelSums[base], fixedPoint.r);
+    atomicAdd(voxelSums[base + 1u], fixedPoint.g);
+    atomicAdd(voxelSums[base + 2u], fixedPoint.b);
+    atomicAdd(voxelSums[base + 3u], 1u);
+}
@@ -0,0 +1,40 @@
+# version 450 core
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+in vec3 vertexPos[];
+in vec3 vertexNormal[];
+in vec2 vertexTexCoord[];
+
+out vec3 worldPos;
+out vec3 normal;
+out vec2 texCoord;
+
+// the voxel grid is the cube gridMin .. gridMin + gridSize
+uniform vec3 gridMin;
+uniform float gridSize;
+
+// Projects the triangle along the axis its face normal is closest to, so
+// it covers the most fragments of the voxel-resolution viewport.
+void main()
+{
+    vec3 faceNormal = abs(cross(vertexPos[1] - vertexPos[0], vertexPos[2] - vertexPos[0]));
+    for (int i = 0; i < 3; ++i)
+    {
+        vec3 p = (vertexPos[i] - gridMin) / gridSize * 2.0 - 1.0;
+        vec2 xy;
+        if (faceNormal.x >= faceNormal.y && faceNormal.x >= faceNormal.z)
+            xy = p.yz;
+        else if (faceNormal.y >= faceNormal.z)
+            xy = p.xz;
+        else
+            xy = p.xy;
+        gl_Position = vec4(xy, 0.0, 1.0);
+        worldPos = vertexPos[i];
+        normal = vertexNormal[i];
+        texCoord = vertexTexCoord[i];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -0,0 +1,20 @@
+# version 450 core
+
+layout (location=0) in vec3 position;
+layout (location=1) in vec3 inNormal;
+layout (location=2) in vec2 inTexCoord;
+
+out vec3 vertexPos;
+out vec3 vertexNormal;
+out vec2 vertexTexCoord;
+
+uniform mat4 modelMat;
+
+// world space, projected per triangle in voxelize.gs
+void main()
+{
+    vertexPos = (modelMat * vec4(position, 1.0)).xyz;
+    vertexNormal = mat3(modelMat) * inNormal;
+    vertexTexCoord = inTexCoord;
+    gl_Position = vec4(vertexPos, 1.0);
+}
@@ -0,0 +1,26 @@
+# version 450 core
+
+layout (local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+layout (rgba16f, binding = 0) uniform writeonly image3D imageVoxels;
+
+#include "voxelsums.glsl"
+
+// Every voxel gets the mean lit radiance of the fragments that fell in it,
+// alpha 1 where there were any, so the result does not depend on draw order.
+void main()
+{
+    ivec3 res = imageSize(imageVoxels);
+    ivec3 voxel = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(voxel, res)))
+        return;
+    uint base = voxelSumIndex(voxel, res);
+    uint count = voxelSums[base + 3u];
+    if (count == 0u)
+    {
+        imageStore(imageVoxels, voxel, vec4(0.0));
+        return;
+    }
+    vec3 sum = vec3(voxelSums[base], voxelSums[base + 1u], voxelSums[base + 2u]) / sumScale;
+    imageStore(imageVoxels, voxel, vec4(sum / float(count), 1.0));
+}
@@ -0,0 +1,19 @@
+// Per-voxel sums that voxelize.fs accumulates with atomics and
+// voxelresolve.cs averages: red, green and blue in fixed point with
+// sumScale steps per unit, then the fragment count, four uints per voxel
+// with x fastest.
+
+layout (std430, binding = 8) buffer VoxelSums
+{
+    uint voxelSums[];
+};
+
+const float sumScale = 1024.0;
+// radiance is clamped here, so a voxel holds 2^32 / (sumScale * maxRadiance)
+// fragments before a sum wraps
+const float maxRadiance = 16.0;
+
+uint voxelSumIndex(ivec3 voxel, ivec3 res)
+{
+    return 4u * uint((voxel.z * res.y + voxel.y) * res.x + voxel.x);
+}
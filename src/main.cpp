@@ -249,32 +249,126 @@ static void keyCallback(GLFWwindow *window, int key, int scanCode, int action, i
         case GLFW_KEY_F1:
             screenShot();
             break;
+        case GLFW_KEY_F2:
+            renderMode ^= PASS_FUSED;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F3:
+            renderMode ^= PASS_TILED;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F4:
+            scene->benchmark(camera);
+            break;
+        case GLFW_KEY_F5:
+            renderMode ^= PASS_TEMPORAL;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F6:
+            renderMode ^= PASS_DEINTERLEAVED;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F7:
+            renderMode ^= PASS_DEPTH_PYRAMID;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F8:
+            renderMode ^= PASS_VISIBILITY;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F9:
+            renderMode ^= PASS_DEPTH_PREPASS;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F10:
+            renderMode ^= PASS_BENT_NORMAL;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F11:
+            renderMode ^= PASS_ENV_SAMPLING;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_F12:
+            scene->tuneSampleCount(camera);
+            break;
+        case GLFW_KEY_K:
+            renderMode = renderMode & ~KERNEL_TYPE_MASK | (renderMode + KERNEL_TYPE_HALTON) & KERNEL_TYPE_MASK;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_N:
+            renderMode ^= PASS_BLUE_NOISE;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_M:
+            renderMode ^= PASS_ADAPTIVE;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_L:
+            renderMode ^= PASS_ADAPTIVE_TILES;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_R:
+            renderMode ^= PASS_RADIANCE_PYRAMID;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_B:
+            renderMode ^= PASS_FEEDBACK;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_T:
+            renderMode ^= PASS_RESTIR;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_G:
+            renderMode ^= PASS_SDF_AO;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_P:
+            renderMode ^= PASS_PRT;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_H:
+            renderMode ^= PASS_HYBRID;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_V:
+            renderMode ^= PASS_VOXEL_GI;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_I:
+            renderMode ^= PASS_PROBES;
+            scene->setMode(renderMode);
+            break;
+        case GLFW_KEY_7:
+            renderMode = renderMode & ~AO_TYPE_MASK | AO_TYPE_GTAO;
+            scene->setMode(renderMode);
+            break;
         case GLFW_KEY_8:
-            renderMode = AO_TYPE_NONE | renderMode & OUTPUT_TYPE_MASK;
+            renderMode = renderMode & ~AO_TYPE_MASK | AO_TYPE_NONE;
             scene->setMode(renderMode);
             break;
         case GLFW_KEY_9:
-            renderMode = AO_TYPE_SSAO | renderMode & OUTPUT_TYPE_MASK;
+            renderMode = renderMode & ~AO_TYPE_MASK | AO_TYPE_SSAO;
             scene->setMode(renderMode);
             break;
         case GLFW_KEY_0:
-            renderMode = AO_TYPE_SSDO | renderMode & OUTPUT_TYPE_MASK;
+            renderMode = renderMode & ~AO_TYPE_MASK | AO_TYPE_SSDO;
             scene->setMode(renderMode);
             break;
         case GLFW_KEY_1:
-            renderMode = renderMode & AO_TYPE_MASK | OUTPUT_TYPE_FULL;
+            renderMode = renderMode & ~OUTPUT_TYPE_MASK | OUTPUT_TYPE_FULL;
             scene->setMode(renderMode);
             break;
         case GLFW_KEY_2:
-            renderMode = renderMode & AO_TYPE_MASK | OUTPUT_TYPE_DIRECT;
+            renderMode = renderMode & ~OUTPUT_TYPE_MASK | OUTPUT_TYPE_DIRECT;
             scene->setMode(renderMode);
             break;
         case GLFW_KEY_3:
-            renderMode = renderMode & AO_TYPE_MASK | OUTPUT_TYPE_BOUNCE;
+            renderMode = renderMode & ~OUTPUT_TYPE_MASK | OUTPUT_TYPE_BOUNCE;
             scene->setMode(renderMode);
             break;
         case GLFW_KEY_4:
-            renderMode = renderMode & AO_TYPE_MASK | OUTPUT_TYPE_AO;
+            renderMode = renderMode & ~OUTPUT_TYPE_MASK | OUTPUT_TYPE_AO;
             scene->setMode(renderMode);
             break;
         }
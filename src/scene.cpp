@@ -1,8 +1,14 @@
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <random>
+#include <thread>
+#include <xmmintrin.h>
 
 #include "scene.h"
 #include "utils.h"
@@ -14,6 +20,69 @@
 using namespace std;
 
 const int shadowMapSize = 4096;
+const int directBlurRadius = 4;
+const int indirectBlurRadius = 4;
+const int lightBlurRadius = 2;
+const float fusedRadius = 0.1f;
+const int tileSize = 16;
+const int temporalSampleCount = 16;
+// the visibility ID keeps 8 bits for the draw index, and all ones is background
+const size_t maxVisibilityDraws = 255;
+// frameIndex wraps here, a multiple of the 64 / temporalSampleCount kernel cycle
+const int temporalFramePeriod = 1 << 20;
+const float goldenAngle = 2.39996323f;
+const int prepassProbeInterval = 256;
+const int environmentSize = 128;
+const int environmentLevels = 6;
+const int envPoolSize = 256;
+const int envSampleCount = 16;
+const int blueNoiseSize = 64;
+const int referenceSampleCount = 1024;
+const int groundTruthSampleCount = 4096;
+// reference kernels are seeded from here; seed 1 is the engine's default and
+// would reproduce the production random kernel
+const unsigned referenceSeedSalt = 0x5eed0000u;
+const int classifyTileSize = 8;
+const int adaptiveStatsInterval = 120;
+const int radianceLevels = 7;
+const float radianceBounceRadius = 1.0f;
+const int sdfResolution = 64;
+const float sdfPadding = 0.1f;
+// baked fields and transfer are derived data, kept out of the model directories
+const std::string bakeCacheDir = "cache";
+const int maxDistanceFieldInstances = 64;
+// cones start sdfStartVoxels voxels off the surface and end sdfTraceVoxels away
+const float sdfStartVoxels = 2.0f;
+const float sdfTraceVoxels = 16.0f;
+const int bvhBins = 12;
+const int bvhMinLeaf = 2;
+const int bvhMaxLeaf = 8;
+const float bvhTraversalCost = 1.0f;
+// a traversal holds at most one pending sibling per level plus two children,
+// so the build stops splitting at bvhStackSize - 1 levels
+const int bvhStackSize = 64;
+const int bvhMaxDepth = bvhStackSize - 1;
+// the top bvhParallelDepth levels build their right subtree on a new
+// thread, up to 2^bvhParallelDepth threads, when the node is big enough
+const int bvhParallelDepth = 3;
+const int bvhParallelMinCount = 4096;
+const int prtSampleCount = 256;
+const float prtRayOffset = 1e-4f;
+const int hybridStatsInterval = 120;
+const int voxelResolution = 128;
+// probes along the longest axis of the scene
+const int probeGridMax = 12;
+const int probeFaceSize = 16;
+// the work group size of probeproject.cs
+const int probeMomentSize = 8;
+// cosine power of the lobe each moment texel averages distances over
+const float probeMomentSharpness = 16.0f;
+// GPU time the probe bakes of one frame are sized to, never more than
+// probeBakesPerFrame of them
+const double probeBudgetMs = 1.0;
+const int probeBakesPerFrame = 32;
+const glm::vec3 sceneLightPos{50.0f, -100.0f, 100.0f};
+const glm::vec3 sceneLightDir{-0.5f, 1.0f, -1.0f};
 
 // #define DEBUG
 
@@ -37,7 +106,7 @@ Shader::Shader(const std::string &fileName, GLenum shaderType)
         _obj = 0;
     }};
 
-    const string shaderCode = loadFile(fileName);
+    const string shaderCode = loadFileWithIncludes(fileName);
     GLint isCompiled{0};
     const char *code = shaderCode.c_str();
     glShaderSource(_obj, 1, &code, NULL);
@@ -180,49 +249,75 @@ void Mesh::setup()
     // std::cerr << max_x << " " << max_y << " " << max_z << std::endl;
     // std::cerr << min_x << " " << min_y << " " << min_z << std::endl;
 
+    // Positions and the remaining attributes go to separate buffers, so
+    // depth-only passes fetch 12 bytes per vertex instead of sizeof(Vertex).
+    std::vector<glm::vec3> positions;
+    std::vector<VertexAttributes> attributes;
+    positions.reserve(vertices.size());
+    attributes.reserve(vertices.size());
+    for (auto &v : vertices)
+    {
+        positions.push_back(v.position);
+        attributes.push_back(VertexAttributes{v.normal, v.texCoords, v.tangent, v.bitangent});
+    }
+
     glGenVertexArrays(1, &VAO);
+    glGenVertexArrays(1, &positionVAO);
+    glGenBuffers(1, &positionVBO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, attributes.size() * sizeof(VertexAttributes), attributes.data(), GL_STATIC_DRAW);
 
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
+    glBindVertexArray(VAO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
                  &indices[0], GL_STATIC_DRAW);
 
     // vertex positions
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
     // vertex normals
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, normal));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexAttributes), (void *)offsetof(VertexAttributes, normal));
     // vertex texture coords
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, texCoords));
-    // /*
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexAttributes), (void *)offsetof(VertexAttributes, texCoords));
     // vertex tangent coords
     glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, tangent));
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(VertexAttributes), (void *)offsetof(VertexAttributes, tangent));
     // vertex bitangent coords
     glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, bitangent));
-    // */
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(VertexAttributes), (void *)offsetof(VertexAttributes, bitangent));
+
+    // position-only VAO for the shadow, depth pre-pass and visibility passes
+    glBindVertexArray(positionVAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
 
     glBindVertexArray(0);
 }
 Mesh::Mesh(Mesh &&other)
     : vertices(other.vertices), indices(other.indices), textures(other.textures),
-      params(other.params), VAO(other.VAO), VBO(other.VBO), EBO(other.EBO)
+      params(other.params), VAO(other.VAO), positionVAO(other.positionVAO),
+      positionVBO(other.positionVBO), VBO(other.VBO), EBO(other.EBO), transferVBO(other.transferVBO)
 {
     other.vertices.clear();
     other.indices.clear();
     other.textures.clear();
     other.VAO = 0;
+    other.positionVAO = 0;
+    other.positionVBO = 0;
     other.VBO = 0;
     other.EBO = 0;
+    other.transferVBO = 0;
 }
 Mesh &Mesh::operator=(Mesh &&other)
 {
@@ -231,29 +326,52 @@ Mesh &Mesh::operator=(Mesh &&other)
     textures = other.textures;
     params = other.params;
     VAO = other.VAO;
+    positionVAO = other.positionVAO;
+    positionVBO = other.positionVBO;
     VBO = other.VBO;
     EBO = other.EBO;
+    transferVBO = other.transferVBO;
     other.vertices.clear();
     other.indices.clear();
     other.textures.clear();
     other.VAO = 0;
+    other.positionVAO = 0;
+    other.positionVBO = 0;
     other.VBO = 0;
     other.EBO = 0;
+    other.transferVBO = 0;
     return *this;
 }
 Mesh::~Mesh()
 {
     if (VAO)
         glDeleteVertexArrays(1, &VAO);
+    if (positionVAO)
+        glDeleteVertexArrays(1, &positionVAO);
     if (EBO)
         glDeleteBuffers(1, &EBO);
+    if (positionVBO)
+        glDeleteBuffers(1, &positionVBO);
     if (VBO)
         glDeleteBuffers(1, &VBO);
+    if (transferVBO)
+        glDeleteBuffers(1, &transferVBO);
 }
 void Mesh::bindVAO() const
 {
     glBindVertexArray(VAO);
 }
+void Mesh::bindPositionVAO() const
+{
+    glBindVertexArray(positionVAO);
+}
+// Exposes the position, attribute and index buffers to shaders as storage buffers.
+void Mesh::bindStorage(GLuint positionBinding, GLuint attributeBinding, GLuint indexBinding) const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, positionBinding, positionVBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, attributeBinding, VBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, indexBinding, EBO);
+}
 void Mesh::bindTexture(const std::string &name) const
 {
     auto texture = textures.find(name);
@@ -288,6 +406,743 @@ void Mesh::draw() const
     //     std::cerr << feedback[i * 3] << " " << feedback[i * 3 + 1] << " " << feedback[i * 3 + 2] << std::endl;
     // delete[] feedback;
 }
+const std::vector<Vertex> &Mesh::getVertices() const noexcept
+{
+    return vertices;
+}
+const std::vector<unsigned int> &Mesh::getIndices() const noexcept
+{
+    return indices;
+}
+// Adds the per-vertex PRT coefficients to the VAO as attributes 5-7, three
+// vec3 per vertex.
+void Mesh::setTransfer(const std::vector<float> &coefficients)
+{
+    if (!transferVBO)
+        glGenBuffers(1, &transferVBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, transferVBO);
+    glBufferData(GL_ARRAY_BUFFER, coefficients.size() * sizeof(float), coefficients.data(), GL_STATIC_DRAW);
+    for (int i = 0; i != 3; ++i)
+    {
+        glEnableVertexAttribArray(5 + i);
+        glVertexAttribPointer(5 + i, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void *)(3 * i * sizeof(float)));
+    }
+    glBindVertexArray(0);
+}
+// FNV-1a, names the cache files of the CPU bakes
+const std::uint64_t fnvOffset = 14695981039346656037ull;
+static std::uint64_t hashBytes(std::uint64_t key, const void *data, size_t size)
+{
+    auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i != size; ++i)
+        key = (key ^ bytes[i]) * 1099511628211ull;
+    return key;
+}
+// Ericson, Real-Time Collision Detection 5.1.5
+static glm::vec3 closestPointOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float sum = va + vb + vc;
+    // degenerate triangle
+    if (sum <= 0.0f)
+        return a;
+    return a + ab * (vb / sum) + ac * (vc / sum);
+}
+// Squared distance from four points at once to one triangle, in the
+// branchless form: the plane distance when a point projects inside all three
+// edges, otherwise the distance to the nearest edge segment.
+struct TriangleDistance4
+{
+    TriangleDistance4(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+    {
+        glm::vec3 normal = glm::cross(b - a, a - c);
+        float normalSq = glm::dot(normal, normal);
+        glm::vec3 corners[] = {a, b, c};
+        for (int e = 0; e != 3; ++e)
+        {
+            glm::vec3 edge = corners[(e + 1) % 3] - corners[e];
+            glm::vec3 side = glm::cross(edge, normal);
+            float edgeSq = glm::dot(edge, edge);
+            for (int axis = 0; axis != 3; ++axis)
+            {
+                origin[e][axis] = _mm_set1_ps(corners[e][axis]);
+                edges[e][axis] = _mm_set1_ps(edge[axis]);
+                sides[e][axis] = _mm_set1_ps(side[axis]);
+            }
+            invEdgeSq[e] = _mm_set1_ps(edgeSq > 0.0f ? 1.0f / edgeSq : 0.0f);
+        }
+        for (int axis = 0; axis != 3; ++axis)
+            normals[axis] = _mm_set1_ps(normal[axis]);
+        invNormalSq = _mm_set1_ps(normalSq > 0.0f ? 1.0f / normalSq : 0.0f);
+    }
+    __m128 operator()(__m128 px, __m128 py, __m128 pz) const
+    {
+        auto dot = [](const __m128 *u, __m128 x, __m128 y, __m128 z) {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(u[0], x), _mm_mul_ps(u[1], y)), _mm_mul_ps(u[2], z));
+        };
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        __m128 edgeSq = _mm_set1_ps(std::numeric_limits<float>::max());
+        __m128 planeDot = zero;
+        for (int e = 0; e != 3; ++e)
+        {
+            __m128 x = _mm_sub_ps(px, origin[e][0]);
+            __m128 y = _mm_sub_ps(py, origin[e][1]);
+            __m128 z = _mm_sub_ps(pz, origin[e][2]);
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(dot(sides[e], x, y, z), zero));
+            if (e == 0)
+                planeDot = dot(normals, x, y, z);
+            __m128 t = _mm_mul_ps(dot(edges[e], x, y, z), invEdgeSq[e]);
+            t = _mm_min_ps(_mm_max_ps(t, zero), one);
+            __m128 dx = _mm_sub_ps(_mm_mul_ps(edges[e][0], t), x);
+            __m128 dy = _mm_sub_ps(_mm_mul_ps(edges[e][1], t), y);
+            __m128 dz = _mm_sub_ps(_mm_mul_ps(edges[e][2], t), z);
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            edgeSq = _mm_min_ps(edgeSq, d);
+        }
+        __m128 planeSq = _mm_mul_ps(_mm_mul_ps(planeDot, planeDot), invNormalSq);
+        return _mm_or_ps(_mm_and_ps(inside, planeSq), _mm_andnot_ps(inside, edgeSq));
+    }
+
+    __m128 origin[3][3];
+    __m128 edges[3][3];
+    __m128 sides[3][3];
+    __m128 invEdgeSq[3];
+    __m128 normals[3];
+    __m128 invNormalSq;
+};
+
+DistanceField::DistanceField(const Mesh &mesh, int res, const std::string &cacheDir)
+    : resolution(res)
+{
+    auto &vertices = mesh.getVertices();
+    std::vector<glm::vec3> triangles;
+    triangles.reserve(mesh.getIndices().size());
+    for (auto i : mesh.getIndices())
+        triangles.push_back(vertices[i].position);
+
+    // a hash of the triangles and the resolution names the cache file
+    std::uint64_t key = hashBytes(fnvOffset, triangles.data(), triangles.size() * sizeof(glm::vec3));
+    key = hashBytes(key, &resolution, sizeof(resolution));
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.sdf", static_cast<unsigned long long>(key));
+    auto file = cacheDir + "/" + name;
+
+    if (load(file, key))
+    {
+        std::cout << "Distance field loaded from " << file << std::endl;
+        return;
+    }
+    std::cout << "Baking distance field of " << triangles.size() / 3 << " triangles" << std::endl;
+    auto start = Clock::now();
+    bake(triangles);
+    std::cout << "Distance field baked in " << duration2secs(Clock::now() - start) << "s" << std::endl;
+    save(file, key);
+}
+int DistanceField::getResolution() const noexcept
+{
+    return resolution;
+}
+glm::vec3 DistanceField::getBoxMin() const noexcept
+{
+    return boxMin;
+}
+glm::vec3 DistanceField::getBoxMax() const noexcept
+{
+    return boxMax;
+}
+const std::vector<float> &DistanceField::getDistances() const noexcept
+{
+    return distances;
+}
+// Exact distances in a band around every triangle, spread to the rest of
+// the grid by fast sweeping over the nearest triangle of the neighbours
+// (Bridson's makelevelset3). The sign comes from a flood fill of the
+// outside through voxels clear of the surface; voxels within half a
+// diagonal of it take the side of their nearest triangle's face normal.
+void DistanceField::bake(const std::vector<glm::vec3> &triangles)
+{
+    int res = resolution;
+    int count = static_cast<int>(triangles.size()) / 3;
+    distances.assign(res * res * res, std::numeric_limits<float>::max());
+    if (count == 0)
+    {
+        boxMin = glm::vec3{-1.0f};
+        boxMax = glm::vec3{1.0f};
+        return;
+    }
+
+    glm::vec3 lo{std::numeric_limits<float>::max()};
+    glm::vec3 hi{-std::numeric_limits<float>::max()};
+    for (auto &p : triangles)
+    {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    // a cube, so voxels are isotropic, with room for the field outside the surface
+    glm::vec3 extent = hi - lo;
+    float half = std::max(extent.x, std::max(extent.y, extent.z)) * (0.5f + sdfPadding);
+    boxMin = (lo + hi) * 0.5f - half;
+    boxMax = (lo + hi) * 0.5f + half;
+    float voxel = 2.0f * half / res;
+
+    auto index = [res](int i, int j, int k) { return (k * res + j) * res + i; };
+    auto center = [this, voxel](int i, int j, int k) { return boxMin + (glm::vec3(i, j, k) + 0.5f) * voxel; };
+    auto triangleDistance = [&triangles](glm::vec3 p, int t) {
+        return glm::length(p - closestPointOnTriangle(p, triangles[3 * t], triangles[3 * t + 1], triangles[3 * t + 2]));
+    };
+    std::vector<int> nearest(res * res * res, -1);
+
+    // every thread owns a range of z slices and walks all triangles, four
+    // voxels of a row at a time
+    const int band = 1;
+    auto bakeSlices = [&](int zBegin, int zEnd) {
+        const __m128 laneOffsets = _mm_set_ps(3.0f * voxel, 2.0f * voxel, voxel, 0.0f);
+        alignas(16) std::array<float, 4> rowDistances;
+        for (int t = 0; t != count; ++t)
+        {
+            glm::vec3 tLo = glm::min(triangles[3 * t], glm::min(triangles[3 * t + 1], triangles[3 * t + 2]));
+            glm::vec3 tHi = glm::max(triangles[3 * t], glm::max(triangles[3 * t + 1], triangles[3 * t + 2]));
+            glm::ivec3 vLo = glm::ivec3(glm::floor((tLo - boxMin) / voxel - 0.5f)) - band;
+            glm::ivec3 vHi = glm::ivec3(glm::ceil((tHi - boxMin) / voxel - 0.5f)) + band;
+            vLo = glm::max(vLo, glm::ivec3(0, 0, zBegin));
+            vHi = glm::min(vHi, glm::ivec3(res - 1, res - 1, zEnd - 1));
+            TriangleDistance4 distanceSq(triangles[3 * t], triangles[3 * t + 1], triangles[3 * t + 2]);
+            for (int k = vLo.z; k <= vHi.z; ++k)
+                for (int j = vLo.y; j <= vHi.y; ++j)
+                    for (int i = vLo.x; i <= vHi.x; i += 4)
+                    {
+                        glm::vec3 p = center(i, j, k);
+                        __m128 px = _mm_add_ps(_mm_set1_ps(p.x), laneOffsets);
+                        _mm_store_ps(rowDistances.data(), _mm_sqrt_ps(distanceSq(px, _mm_set1_ps(p.y), _mm_set1_ps(p.z))));
+                        for (int lane = 0; lane != std::min(4, vHi.x - i + 1); ++lane)
+                        {
+                            int idx = index(i + lane, j, k);
+                            if (rowDistances[lane] < distances[idx])
+                            {
+                                distances[idx] = rowDistances[lane];
+                                nearest[idx] = t;
+                            }
+                        }
+                    }
+        }
+    };
+    int threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    int slicesPerThread = (res + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+    for (int begin = 0; begin < res; begin += slicesPerThread)
+        threads.emplace_back(bakeSlices, begin, std::min(begin + slicesPerThread, res));
+    for (auto &t : threads)
+        t.join();
+
+    auto propagate = [&](int i, int j, int k, int ni, int nj, int nk) {
+        int t = nearest[index(ni, nj, nk)];
+        if (t < 0)
+            return;
+        float d = triangleDistance(center(i, j, k), t);
+        int idx = index(i, j, k);
+        if (d < distances[idx])
+        {
+            distances[idx] = d;
+            nearest[idx] = t;
+        }
+    };
+    for (int pass = 0; pass != 2; ++pass)
+        for (int sweep = 0; sweep != 8; ++sweep)
+        {
+            int di = sweep & 1 ? -1 : 1;
+            int dj = sweep & 2 ? -1 : 1;
+            int dk = sweep & 4 ? -1 : 1;
+            for (int k = dk > 0 ? 1 : res - 2; k >= 0 && k < res; k += dk)
+                for (int j = dj > 0 ? 1 : res - 2; j >= 0 && j < res; j += dj)
+                    for (int i = di > 0 ? 1 : res - 2; i >= 0 && i < res; i += di)
+                    {
+                        propagate(i, j, k, i - di, j, k);
+                        propagate(i, j, k, i, j - dj, k);
+                        propagate(i, j, k, i - di, j - dj, k);
+                        propagate(i, j, k, i, j, k - dk);
+                        propagate(i, j, k, i - di, j, k - dk);
+                        propagate(i, j, k, i, j - dj, k - dk);
+                        propagate(i, j, k, i - di, j - dj, k - dk);
+                    }
+        }
+
+    float shell = voxel * 0.8660254f;
+    std::vector<char> outside(res * res * res, 0);
+    std::vector<int> stack;
+    for (int k = 0; k != res; ++k)
+        for (int j = 0; j != res; ++j)
+            for (int i = 0; i != res; ++i)
+            {
+                bool border = i == 0 || j == 0 || k == 0 || i == res - 1 || j == res - 1 || k == res - 1;
+                int idx = index(i, j, k);
+                if (border && distances[idx] > shell)
+                {
+                    outside[idx] = 1;
+                    stack.push_back(idx);
+                }
+            }
+    while (!stack.empty())
+    {
+        int idx = stack.back();
+        stack.pop_back();
+        int i = idx % res;
+        int j = idx / res % res;
+        int k = idx / (res * res);
+        const glm::ivec3 steps[] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+        for (auto step : steps)
+        {
+            glm::ivec3 n{i + step.x, j + step.y, k + step.z};
+            if (glm::any(glm::lessThan(n, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(n, glm::ivec3(res))))
+                continue;
+            int nIdx = index(n.x, n.y, n.z);
+            if (!outside[nIdx] && distances[nIdx] > shell)
+            {
+                outside[nIdx] = 1;
+                stack.push_back(nIdx);
+            }
+        }
+    }
+    for (int k = 0; k != res; ++k)
+        for (int j = 0; j != res; ++j)
+            for (int i = 0; i != res; ++i)
+            {
+                int idx = index(i, j, k);
+                bool inside = !outside[idx];
+                if (distances[idx] <= shell)
+                {
+                    int t = nearest[idx];
+                    glm::vec3 a = triangles[3 * t], b = triangles[3 * t + 1], c = triangles[3 * t + 2];
+                    glm::vec3 p = center(i, j, k);
+                    inside = glm::dot(p - closestPointOnTriangle(p, a, b, c), glm::cross(b - a, c - a)) < 0.0f;
+                }
+                if (inside)
+                    distances[idx] = -distances[idx];
+            }
+}
+// Cache layout: key, resolution, box min and max, then resolution^3 floats
+// with x fastest.
+bool DistanceField::load(const std::string &file, std::uint64_t key)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+        return false;
+    std::uint64_t fileKey{0};
+    int fileResolution{0};
+    in.read(reinterpret_cast<char *>(&fileKey), sizeof(fileKey));
+    in.read(reinterpret_cast<char *>(&fileResolution), sizeof(fileResolution));
+    if (!in || fileKey != key || fileResolution != resolution)
+        return false;
+    in.read(reinterpret_cast<char *>(&boxMin), sizeof(boxMin));
+    in.read(reinterpret_cast<char *>(&boxMax), sizeof(boxMax));
+    distances.resize(resolution * resolution * resolution);
+    in.read(reinterpret_cast<char *>(distances.data()), distances.size() * sizeof(float));
+    return static_cast<bool>(in);
+}
+void DistanceField::save(const std::string &file, std::uint64_t key) const
+{
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(file).parent_path(), error);
+    std::ofstream out(file, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Cannot write distance field cache " << file << std::endl;
+        return;
+    }
+    out.write(reinterpret_cast<const char *>(&key), sizeof(key));
+    out.write(reinterpret_cast<const char *>(&resolution), sizeof(resolution));
+    out.write(reinterpret_cast<const char *>(&boxMin), sizeof(boxMin));
+    out.write(reinterpret_cast<const char *>(&boxMax), sizeof(boxMax));
+    out.write(reinterpret_cast<const char *>(distances.data()), distances.size() * sizeof(float));
+}
+// Möller-Trumbore on triangles first to first + 3 of the BVH streams, a bit
+// per triangle with a hit at 0 < t < tMax
+static int intersectTriangles4(glm::vec3 origin, glm::vec3 dir, const std::array<std::vector<float>, 9> &streams,
+                               int first, float tMax)
+{
+    __m128 v[9];
+    for (int s = 0; s != 9; ++s)
+        v[s] = _mm_loadu_ps(streams[s].data() + first);
+    auto cross = [](const __m128 *a, const __m128 *b, __m128 *out) {
+        out[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+        out[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+        out[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+    };
+    auto dot = [](const __m128 *a, const __m128 *b) {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+    };
+    const __m128 *e1 = v + 3;
+    const __m128 *e2 = v + 6;
+    __m128 d[3] = {_mm_set1_ps(dir.x), _mm_set1_ps(dir.y), _mm_set1_ps(dir.z)};
+    __m128 s[3] = {_mm_sub_ps(_mm_set1_ps(origin.x), v[0]),
+                   _mm_sub_ps(_mm_set1_ps(origin.y), v[1]),
+                   _mm_sub_ps(_mm_set1_ps(origin.z), v[2])};
+    __m128 p[3], q[3];
+    cross(d, e2, p);
+    cross(s, e1, q);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 det = dot(e1, p);
+    __m128 invDet = _mm_div_ps(one, det);
+    __m128 u = _mm_mul_ps(dot(s, p), invDet);
+    __m128 w = _mm_mul_ps(dot(d, q), invDet);
+    __m128 t = _mm_mul_ps(dot(e2, q), invDet);
+    // a zero determinant makes the terms infinite or NaN, which fail the tests below
+    __m128 hit = _mm_cmpneq_ps(det, zero);
+    hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+    hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(w, zero), _mm_cmple_ps(_mm_add_ps(u, w), one)));
+    hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(tMax))));
+    return _mm_movemask_ps(hit);
+}
+static float surfaceArea(glm::vec3 lo, glm::vec3 hi)
+{
+    glm::vec3 d = glm::max(hi - lo, glm::vec3{0.0f});
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+BVH::BVH(std::vector<glm::vec3> tris) : triangles(std::move(tris))
+{
+    int count = static_cast<int>(triangles.size()) / 3;
+    if (count == 0)
+        return;
+    std::vector<int> order(count);
+    std::vector<glm::vec3> centroids(count);
+    for (int t = 0; t != count; ++t)
+    {
+        order[t] = t;
+        centroids[t] = (triangles[3 * t] + triangles[3 * t + 1] + triangles[3 * t + 2]) / 3.0f;
+    }
+    nodes.reserve(2 * count);
+    build(nodes, order, centroids, 0, count, 0);
+
+    std::vector<glm::vec3> sorted;
+    sorted.reserve(triangles.size());
+    for (auto t : order)
+        for (int v = 0; v != 3; ++v)
+            sorted.push_back(triangles[3 * t + v]);
+    triangles = std::move(sorted);
+
+    // padded, so a leaf's last group of four loads past the end safely
+    for (auto &stream : streams)
+        stream.assign(count + 3, 0.0f);
+    for (int t = 0; t != count; ++t)
+    {
+        glm::vec3 a = triangles[3 * t];
+        glm::vec3 e1 = triangles[3 * t + 1] - a;
+        glm::vec3 e2 = triangles[3 * t + 2] - a;
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            streams[axis][t] = a[axis];
+            streams[3 + axis][t] = e1[axis];
+            streams[6 + axis][t] = e2[axis];
+        }
+    }
+}
+// Splits order[begin, end) at the best of bvhBins - 1 planes along the
+// longest axis of the centroid bounds, or makes a leaf when that is cheaper
+// or the node is bvhMaxDepth deep. Nodes are appended to out; the ranges of
+// sibling subtrees are disjoint, so near the root they build concurrently.
+int BVH::build(std::vector<BVHNode> &out, std::vector<int> &order, const std::vector<glm::vec3> &centroids,
+               int begin, int end, int depth) const
+{
+    int nodeIndex = static_cast<int>(out.size());
+    out.emplace_back();
+    const float maxFloat = std::numeric_limits<float>::max();
+    glm::vec3 lo{maxFloat}, hi{-maxFloat}, cLo{maxFloat}, cHi{-maxFloat};
+    for (int i = begin; i != end; ++i)
+    {
+        int t = order[i];
+        for (int v = 0; v != 3; ++v)
+        {
+            lo = glm::min(lo, triangles[3 * t + v]);
+            hi = glm::max(hi, triangles[3 * t + v]);
+        }
+        cLo = glm::min(cLo, centroids[t]);
+        cHi = glm::max(cHi, centroids[t]);
+    }
+    out[nodeIndex].boundsMin = lo;
+    out[nodeIndex].boundsMax = hi;
+    out[nodeIndex].offset = begin;
+    out[nodeIndex].count = end - begin;
+
+    int count = end - begin;
+    glm::vec3 cExtent = cHi - cLo;
+    int axis = cExtent.x > cExtent.y ? (cExtent.x > cExtent.z ? 0 : 2) : (cExtent.y > cExtent.z ? 1 : 2);
+    if (count <= bvhMinLeaf || cExtent[axis] <= 0.0f || depth == bvhMaxDepth)
+        return nodeIndex;
+
+    struct Bin
+    {
+        glm::vec3 lo{std::numeric_limits<float>::max()};
+        glm::vec3 hi{-std::numeric_limits<float>::max()};
+        int count{0};
+    };
+    std::array<Bin, bvhBins> bins;
+    auto binOf = [&](int t) {
+        return std::min(bvhBins - 1, static_cast<int>((centroids[t][axis] - cLo[axis]) / cExtent[axis] * bvhBins));
+    };
+    for (int i = begin; i != end; ++i)
+    {
+        int t = order[i];
+        auto &bin = bins[binOf(t)];
+        ++bin.count;
+        for (int v = 0; v != 3; ++v)
+        {
+            bin.lo = glm::min(bin.lo, triangles[3 * t + v]);
+            bin.hi = glm::max(bin.hi, triangles[3 * t + v]);
+        }
+    }
+    // rightCost[s]: count * area of bins s..end, swept from the right
+    std::array<float, bvhBins> rightCost;
+    Bin right;
+    for (int s = bvhBins - 1; s > 0; --s)
+    {
+        right.lo = glm::min(right.lo, bins[s].lo);
+        right.hi = glm::max(right.hi, bins[s].hi);
+        right.count += bins[s].count;
+        rightCost[s] = right.count * surfaceArea(right.lo, right.hi);
+    }
+    Bin left;
+    float bestCost = maxFloat;
+    int bestSplit = 0;
+    for (int s = 0; s != bvhBins - 1; ++s)
+    {
+        left.lo = glm::min(left.lo, bins[s].lo);
+        left.hi = glm::max(left.hi, bins[s].hi);
+        left.count += bins[s].count;
+        float cost = left.count * surfaceArea(left.lo, left.hi) + rightCost[s + 1];
+        if (left.count > 0 && left.count < count && cost < bestCost)
+        {
+            bestCost = cost;
+            bestSplit = s;
+        }
+    }
+    // a triangle test costs 1, a traversal step bvhTraversalCost
+    float splitCost = bvhTraversalCost + bestCost / surfaceArea(lo, hi);
+    if (count <= bvhMaxLeaf && splitCost >= count)
+        return nodeIndex;
+
+    int mid = static_cast<int>(std::partition(order.begin() + begin, order.begin() + end,
+                                              [&](int t) { return binOf(t) <= bestSplit; }) -
+                               order.begin());
+    if (mid == begin || mid == end)
+    {
+        mid = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                         [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+    int rightChild;
+    if (depth < bvhParallelDepth && count >= bvhParallelMinCount)
+    {
+        // the right subtree goes into its own list and is appended after
+        // the left one, its inner nodes' child offsets shifted to match
+        std::vector<BVHNode> rightNodes;
+        std::thread rightBuild([&]() { build(rightNodes, order, centroids, mid, end, depth + 1); });
+        build(out, order, centroids, begin, mid, depth + 1);
+        rightBuild.join();
+        rightChild = static_cast<int>(out.size());
+        for (auto node : rightNodes)
+        {
+            if (node.count == 0)
+                node.offset += rightChild;
+            out.push_back(node);
+        }
+    }
+    else
+    {
+        build(out, order, centroids, begin, mid, depth + 1);
+        rightChild = build(out, order, centroids, mid, end, depth + 1);
+    }
+    out[nodeIndex].offset = rightChild;
+    out[nodeIndex].count = 0;
+    return nodeIndex;
+}
+// Any-hit test of origin + t * dir for 0 < t < tMax.
+bool BVH::occluded(glm::vec3 origin, glm::vec3 dir, float tMax) const
+{
+    if (nodes.empty())
+        return false;
+    glm::vec3 invDir = 1.0f / dir;
+    std::array<int, bvhStackSize> stack;
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        int nodeIndex = stack[--top];
+        const auto &node = nodes[nodeIndex];
+        glm::vec3 t0 = (node.boundsMin - origin) * invDir;
+        glm::vec3 t1 = (node.boundsMax - origin) * invDir;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+        if (enter > exit)
+            continue;
+        if (node.count > 0)
+        {
+            for (int t = node.offset; t < node.offset + node.count; t += 4)
+            {
+                int lanes = std::min(4, node.offset + node.count - t);
+                if (intersectTriangles4(origin, dir, streams, t, tMax) & ((1 << lanes) - 1))
+                    return true;
+            }
+        }
+        else
+        {
+            // cannot overflow, build bounds the depth by bvhMaxDepth
+            assert(top + 2 <= bvhStackSize);
+            stack[top++] = node.offset;
+            stack[top++] = nodeIndex + 1;
+        }
+    }
+    return false;
+}
+const std::vector<BVHNode> &BVH::getNodes() const noexcept
+{
+    return nodes;
+}
+const std::vector<glm::vec3> &BVH::getTriangles() const noexcept
+{
+    return triangles;
+}
+// Real spherical harmonics of bands 0 to 2
+static std::array<float, 9> shBasis(glm::vec3 d)
+{
+    return {
+        0.282095f,
+        0.488603f * d.y,
+        0.488603f * d.z,
+        0.488603f * d.x,
+        1.092548f * d.x * d.y,
+        1.092548f * d.y * d.z,
+        0.315392f * (3.0f * d.z * d.z - 1.0f),
+        1.092548f * d.x * d.z,
+        0.546274f * (d.x * d.x - d.y * d.y)};
+}
+RadianceTransfer::RadianceTransfer(const Mesh &mesh, glm::mat3 modelRot, const std::string &cacheDir)
+{
+    auto &vertices = mesh.getVertices();
+    std::uint64_t key = hashBytes(fnvOffset, vertices.data(), vertices.size() * sizeof(Vertex));
+    key = hashBytes(key, mesh.getIndices().data(), mesh.getIndices().size() * sizeof(unsigned int));
+    key = hashBytes(key, &modelRot, sizeof(modelRot));
+    key = hashBytes(key, &prtSampleCount, sizeof(prtSampleCount));
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.prt", static_cast<unsigned long long>(key));
+    auto file = cacheDir + "/" + name;
+
+    std::ifstream in(file, std::ios::binary);
+    std::uint64_t fileKey{0};
+    if (in.read(reinterpret_cast<char *>(&fileKey), sizeof(fileKey)) && fileKey == key)
+    {
+        coefficients.resize(vertices.size() * 9);
+        if (in.read(reinterpret_cast<char *>(coefficients.data()), coefficients.size() * sizeof(float)))
+        {
+            std::cout << "Transfer loaded from " << file << std::endl;
+            return;
+        }
+    }
+
+    std::cout << "Baking transfer of " << vertices.size() << " vertices" << std::endl;
+    auto start = Clock::now();
+    bake(mesh, modelRot);
+    std::cout << "Transfer baked in " << duration2secs(Clock::now() - start) << "s" << std::endl;
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(file).parent_path(), error);
+    std::ofstream out(file, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Cannot write transfer cache " << file << std::endl;
+        return;
+    }
+    out.write(reinterpret_cast<const char *>(&key), sizeof(key));
+    out.write(reinterpret_cast<const char *>(coefficients.data()), coefficients.size() * sizeof(float));
+}
+const std::vector<float> &RadianceTransfer::getCoefficients() const noexcept
+{
+    return coefficients;
+}
+// T_i = integral of V(w) max(n.w, 0) Y_i(w) over the sphere, estimated with
+// prtSampleCount Fibonacci-sphere directions shared by every vertex.
+void RadianceTransfer::bake(const Mesh &mesh, glm::mat3 modelRot)
+{
+    auto &vertices = mesh.getVertices();
+    std::vector<glm::vec3> triangles;
+    triangles.reserve(mesh.getIndices().size());
+    glm::vec3 lo{std::numeric_limits<float>::max()};
+    glm::vec3 hi{-std::numeric_limits<float>::max()};
+    for (auto i : mesh.getIndices())
+    {
+        triangles.push_back(vertices[i].position);
+        lo = glm::min(lo, vertices[i].position);
+        hi = glm::max(hi, vertices[i].position);
+    }
+    BVH bvh(std::move(triangles));
+    // rays leave slightly above the surface so they miss their own triangles
+    float offset = prtRayOffset * glm::length(hi - lo);
+
+    std::vector<glm::vec3> directions(prtSampleCount);
+    std::vector<std::array<float, 9>> basis(prtSampleCount);
+    for (int i = 0; i != prtSampleCount; ++i)
+    {
+        float z = 1.0f - (2.0f * i + 1.0f) / prtSampleCount;
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        directions[i] = glm::vec3{r * std::cos(i * goldenAngle), r * std::sin(i * goldenAngle), z};
+        basis[i] = shBasis(modelRot * directions[i]);
+    }
+    float weight = 4.0f * glm::pi<float>() / prtSampleCount;
+
+    coefficients.assign(vertices.size() * 9, 0.0f);
+    auto bakeVertices = [&](int begin, int end) {
+        for (int v = begin; v < end; ++v)
+        {
+            glm::vec3 normal = glm::normalize(vertices[v].normal);
+            glm::vec3 origin = vertices[v].position + normal * offset;
+            float *transfer = &coefficients[9 * v];
+            for (int i = 0; i != prtSampleCount; ++i)
+            {
+                float cosTheta = glm::dot(normal, directions[i]);
+                if (cosTheta <= 0.0f || bvh.occluded(origin, directions[i], std::numeric_limits<float>::max()))
+                    continue;
+                for (int l = 0; l != 9; ++l)
+                    transfer[l] += cosTheta * basis[i][l] * weight;
+            }
+        }
+    };
+    int count = static_cast<int>(vertices.size());
+    int threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    int verticesPerThread = (count + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+    for (int begin = 0; begin < count; begin += verticesPerThread)
+        threads.emplace_back(bakeVertices, begin, std::min(begin + verticesPerThread, count));
+    for (auto &t : threads)
+        t.join();
+}
 Node::Node(const aiNode *node)
     : meshes(node->mMeshes, node->mMeshes + node->mNumMeshes)
 {
@@ -354,49 +1209,47 @@ GBuffer::GBuffer(int width, int height)
     glGenFramebuffers(1, &gBuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
 
-    // - position color buffer
-    glGenTextures(1, &position);
-    glBindTexture(GL_TEXTURE_2D, position);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    // 12 bytes per pixel: position is rebuilt from depth, the normal is
+    // octahedral-encoded and shininess and the binary shadow term share its
+    // texel, see shaders/gbuffer.glsl
+
+    // - depth buffer
+    glGenTextures(1, &depth);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, position, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
 
-    // - normal color buffer
+    // - octahedral normal + shininess + shadow buffer
     glGenTextures(1, &normal);
     glBindTexture(GL_TEXTURE_2D, normal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, width, height, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normal, 0);
 
-    // - color + specular color buffer
+    // - color buffer
     glGenTextures(1, &albedo);
     glBindTexture(GL_TEXTURE_2D, albedo);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, albedo, 0);
-
-    glGenTextures(1, &light);
-    glBindTexture(GL_TEXTURE_2D, light);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, light, 0);
-
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, albedo, 0);
 
     // - tell OpenGL which color attachments we'll use (of this framebuffer) for rendering
-    unsigned int attachments[4] = {
+    unsigned int attachments[2] = {
         GL_COLOR_ATTACHMENT0,
-        GL_COLOR_ATTACHMENT1,
-        GL_COLOR_ATTACHMENT2,
-        GL_COLOR_ATTACHMENT3};
-    glDrawBuffers(4, attachments);
+        GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, attachments);
+
+    glGenBuffers(1, &params);
+    glBindBuffer(GL_UNIFORM_BUFFER, params);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, params);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cerr << "Framebuffer not complete!" << std::endl;
@@ -404,11 +1257,10 @@ GBuffer::GBuffer(int width, int height)
 }
 GBuffer::~GBuffer()
 {
-    glDeleteTextures(1, &position);
+    glDeleteTextures(1, &depth);
     glDeleteTextures(1, &normal);
     glDeleteTextures(1, &albedo);
-    glDeleteTextures(1, &light);
-    glDeleteRenderbuffers(1, &rboDepth);
+    glDeleteBuffers(1, &params);
     glDeleteFramebuffers(1, &gBuffer);
 }
 void GBuffer::bindForRender() const
@@ -418,18 +1270,29 @@ void GBuffer::bindForRender() const
 void GBuffer::bindAsTextures() const
 {
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, position);
+    glBindTexture(GL_TEXTURE_2D, depth);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, normal);
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, albedo);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, light);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, params);
+}
+// The inverse projection the decode helpers rebuild positions with.
+void GBuffer::setProjection(glm::mat4 projMat) const
+{
+    auto invProjMat = glm::inverse(projMat);
+    glBindBuffer(GL_UNIFORM_BUFFER, params);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(invProjMat));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 void GBuffer::unbind() const
 {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
+GLuint GBuffer::getDepth() const noexcept
+{
+    return depth;
+}
 
 SkyBox::SkyBox(const std::string &name, int screenWidth, int screenHeight)
     : width(screenWidth), height(screenHeight)
@@ -452,6 +1315,8 @@ SkyBox::SkyBox(const std::string &name, int screenWidth, int screenHeight)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+        buildDistribution(data, width, height);
+        projectSH(data, width, height);
         delete data;
         // stbi_image_free(data);
     }
@@ -482,6 +1347,16 @@ SkyBox::SkyBox(const std::string &name, int screenWidth, int screenHeight)
     captureViewIndex = capture.uniformLocation("view");
     captureProjIndex = capture.uniformLocation("proj");
 
+    Shader prefilterFS("shaders/prefilter.fs", GL_FRAGMENT_SHADER);
+    prefilter.addShader(captureVS);
+    prefilter.addShader(prefilterFS);
+    prefilter.link();
+    prefilter.use();
+    glUniform1i(prefilter.uniformLocation("cubeMap"), 0);
+    prefilterViewIndex = prefilter.uniformLocation("view");
+    prefilterProjIndex = prefilter.uniformLocation("proj");
+    prefilterApertureIndex = prefilter.uniformLocation("aperture");
+
     CHECKERROR("SkyBox Pipelines");
 
     glGenFramebuffers(1, &FBO);
@@ -509,6 +1384,17 @@ SkyBox::SkyBox(const std::string &name, int screenWidth, int screenHeight)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+    // cone-prefiltered copy of cubeMap, one aperture per mip level
+    glGenTextures(1, &environment);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, environment);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, environmentLevels, GL_RGB16F, environmentSize, environmentSize);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
     float skyboxVertices[] = {
         -1.0f, 1.0f, -1.0f,
         -1.0f, -1.0f, -1.0f,
@@ -569,20 +1455,28 @@ SkyBox::SkyBox(const std::string &name, int screenWidth, int screenHeight)
 SkyBox::~SkyBox()
 {
     glDeleteTextures(1, &hdr);
+    glDeleteTextures(1, &environment);
     glDeleteBuffers(1, &VBO);
     glDeleteVertexArrays(1, &VAO);
 }
+// View of cube face GL_TEXTURE_CUBE_MAP_POSITIVE_X + face from eye, for a
+// 90 degree square projection.
+glm::mat4 SkyBox::captureView(int face, glm::vec3 eye)
+{
+    static const glm::vec3 targets[6] = {
+        {1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+        {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}};
+    static const glm::vec3 ups[6] = {
+        {0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f},
+        {0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
+    return glm::lookAt(eye, eye + targets[face], ups[face]);
+}
 void SkyBox::prepare(glm::mat4 proj) const
 {
     glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-    glm::mat4 captureViews[] =
-        {
-            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
-            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-            glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))};
+    glm::mat4 captureViews[6];
+    for (int i = 0; i != 6; ++i)
+        captureViews[i] = captureView(i, glm::vec3{0.0f});
 
     capture.use();
     glUniformMatrix4fv(captureProjIndex, 1, 0, glm::value_ptr(proj));
@@ -601,9 +1495,32 @@ void SkyBox::prepare(glm::mat4 proj) const
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glDrawArrays(GL_TRIANGLES, 0, 36);
     }
+
+    // mip level i holds cubeMap averaged over cones of half-angle
+    // i / (environmentLevels - 1) * pi / 2, see shaders/environment.glsl
+    prefilter.use();
+    glUniformMatrix4fv(prefilterProjIndex, 1, 0, glm::value_ptr(captureProjection));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+    for (int level = 0; level != environmentLevels; ++level)
+    {
+        int size = environmentSize >> level;
+        glViewport(0, 0, size, size);
+        glUniform1f(prefilterApertureIndex, glm::half_pi<float>() * level / (environmentLevels - 1));
+        for (unsigned int i = 0; i < 6; ++i)
+        {
+            glUniformMatrix4fv(prefilterViewIndex, 1, 0, glm::value_ptr(captureViews[i]));
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, environment, level);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+        }
+    }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glBindVertexArray(0);
     glDepthFunc(GL_LESS);
+    glViewport(0, 0, width, height);
+    CHECKERROR("SkyBox prepare");
 }
 void SkyBox::render(glm::mat4 view, glm::mat4 proj) const
 {
@@ -631,7 +1548,106 @@ void SkyBox::bindCubeMap(int pos) const
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
     CHECKERROR("SkyBox bindCubeMap");
 }
+void SkyBox::bindEnvironment(int pos) const
+{
+    glActiveTexture(GL_TEXTURE0 + pos);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, environment);
+    CHECKERROR("SkyBox bindEnvironment");
+}
+// Builds the tables sampleEnvironment inverts. Pixel (c, r) of the
+// equirectangular map covers a solid angle proportional to cos(latitude).
+void SkyBox::buildDistribution(const float *data, int w, int h)
+{
+    hdrWidth = w;
+    hdrHeight = h;
+    conditionalCDF.assign((w + 1) * h, 0.0f);
+    marginalCDF.assign(h + 1, 0.0f);
+
+    // rows are independent, split them over the hardware threads
+    auto buildRows = [this, data, w, h](int begin, int end) {
+        for (int r = begin; r < end; ++r)
+        {
+            float latitude = ((r + 0.5f) / h - 0.5f) * glm::pi<float>();
+            float *cdf = &conditionalCDF[r * (w + 1)];
+            for (int c = 0; c != w; ++c)
+            {
+                const float *pixel = data + 4 * (r * w + c);
+                float luminance = 0.2126f * pixel[0] + 0.7152f * pixel[1] + 0.0722f * pixel[2];
+                cdf[c + 1] = cdf[c] + luminance * std::cos(latitude);
+            }
+        }
+    };
+    int threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    int rowsPerThread = (h + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+    for (int begin = 0; begin < h; begin += rowsPerThread)
+        threads.emplace_back(buildRows, begin, std::min(begin + rowsPerThread, h));
+    for (auto &t : threads)
+        t.join();
+
+    for (int r = 0; r != h; ++r)
+        marginalCDF[r + 1] = marginalCDF[r] + conditionalCDF[r * (w + 1) + w];
+}
+// False when the HDR map failed to load or is black, so there is no
+// luminance to sample by.
+bool SkyBox::canSampleEnvironment() const noexcept
+{
+    return !marginalCDF.empty() && marginalCDF.back() > 0.0f && std::isfinite(marginalCDF.back());
+}
+// Fills samples with world-space directions distributed like the HDR map's
+// luminance, each with its solid-angle pdf in w. Leaves them untouched when
+// canSampleEnvironment is false.
+void SkyBox::sampleEnvironment(std::vector<glm::vec4> &samples, std::default_random_engine &engine) const
+{
+    if (!canSampleEnvironment())
+        return;
+    const float pi = glm::pi<float>();
+    std::uniform_real_distribution<float> distr{0.0f, 1.0f};
+    float total = marginalCDF.back();
+    for (auto &sample : samples)
+    {
+        auto rowIt = std::upper_bound(marginalCDF.begin() + 1, marginalCDF.end(), distr(engine) * total);
+        int r = std::min(static_cast<int>(rowIt - marginalCDF.begin()) - 1, hdrHeight - 1);
+        auto row = conditionalCDF.begin() + r * (hdrWidth + 1);
+        auto colIt = std::upper_bound(row + 1, row + hdrWidth + 1, distr(engine) * row[hdrWidth]);
+        int c = std::min(static_cast<int>(colIt - row) - 1, hdrWidth - 1);
+
+        float longitude = ((c + distr(engine)) / hdrWidth - 0.5f) * 2.0f * pi;
+        float latitude = ((r + distr(engine)) / hdrHeight - 0.5f) * pi;
+        glm::vec3 dir{std::cos(latitude) * std::cos(longitude), std::sin(latitude), std::cos(latitude) * std::sin(longitude)};
+        // pdf over the map's uv square, divided by the solid angle per uv area
+        float pdfUV = (row[c + 1] - row[c]) / total * hdrWidth * hdrHeight;
+        float pdf = pdfUV / (2.0f * pi * pi * std::max(std::cos(latitude), 1e-4f));
+        sample = glm::vec4{dir, pdf};
+    }
+}
 
+// Projects the map onto 3rd order SH. The coefficient of a direction is the
+// light a surface facing it receives, read from the opposite direction of
+// the map like Illuminance in environment.glsl.
+void SkyBox::projectSH(const float *data, int w, int h)
+{
+    const float pi = glm::pi<float>();
+    environmentSH.fill(glm::vec3{0.0f});
+    for (int r = 0; r != h; ++r)
+    {
+        float latitude = ((r + 0.5f) / h - 0.5f) * pi;
+        float solidAngle = 2.0f * pi / w * pi / h * std::cos(latitude);
+        for (int c = 0; c != w; ++c)
+        {
+            float longitude = ((c + 0.5f) / w - 0.5f) * 2.0f * pi;
+            glm::vec3 dir{std::cos(latitude) * std::cos(longitude), std::sin(latitude), std::cos(latitude) * std::sin(longitude)};
+            const float *pixel = data + 4 * (r * w + c);
+            auto basis = shBasis(-dir);
+            for (int l = 0; l != 9; ++l)
+                environmentSH[l] += glm::vec3{pixel[0], pixel[1], pixel[2]} * basis[l] * solidAngle;
+        }
+    }
+}
+const std::array<glm::vec3, 9> &SkyBox::getEnvironmentSH() const noexcept
+{
+    return environmentSH;
+}
 Renderer::Renderer(const std::vector<Mesh> &mesh) : meshes(mesh)
 {
 }
@@ -643,6 +1659,9 @@ void Renderer::setProj(glm::mat4 projMat)
 {
     _projMat = projMat;
 }
+void Renderer::setScene(std::shared_ptr<Node>)
+{
+}
 BaselineRenderer::BaselineRenderer(
     const std::vector<Mesh> &mesh,
     bool diffuseMap,
@@ -763,25 +1782,79 @@ SSDORenderer::SSDORenderer(
     glUniform1i(geometry.uniformLocation("textureShadow"), 4);
     CHECKERROR("geometry");
 
+    Shader visibilityVS("shaders/visibility.vs"s, GL_VERTEX_SHADER);
+    Shader visibilityFS("shaders/visibility.fs"s, GL_FRAGMENT_SHADER);
+    visibility.addShader(visibilityVS);
+    visibility.addShader(visibilityFS);
+    visibility.link();
+    visibility.use();
+    visibilityWVPIndex = visibility.uniformLocation("WVP");
+    visibilityDrawIDIndex = visibility.uniformLocation("drawID");
+    makeVisibilityFBO();
+    CHECKERROR("visibility");
+
+    // same position-only vertex path, so depth matches geometry.vs exactly
+    Shader prepassFS("shaders/shadow.fs"s, GL_FRAGMENT_SHADER);
+    prepass.addShader(visibilityVS);
+    prepass.addShader(prepassFS);
+    prepass.link();
+    prepass.use();
+    prepassWVPIndex = prepass.uniformLocation("WVP");
+    glGenQueries(2, prepassQueries.data());
+    CHECKERROR("prepass");
+
     Shader quadVS("shaders/quad.vs"s, GL_VERTEX_SHADER);
+    Shader resolveFS("shaders/resolve.fs"s, GL_FRAGMENT_SHADER);
+    resolve.addShader(quadVS);
+    resolve.addShader(resolveFS);
+    resolve.link();
+    resolve.use();
+    glUniform1i(resolve.uniformLocation("textureDiffuse"), 0);
+    glUniform1i(resolve.uniformLocation("textureNormals"), 2);
+    glUniform1i(resolve.uniformLocation("textureShadow"), 4);
+    glUniform1i(resolve.uniformLocation("textureVisibility"), 5);
+    resolveDrawIDIndex = resolve.uniformLocation("drawID");
+    resolveModelMatIndex = resolve.uniformLocation("modelMat");
+    resolveWVPIndex = resolve.uniformLocation("WVP");
+    resolveLightMatIndex = resolve.uniformLocation("lightMat");
+    resolveLightDirIndex = resolve.uniformLocation("lightDir");
+    resolveShininessIndex = resolve.uniformLocation("shininess");
+    CHECKERROR("resolve");
+
     Shader SSDOFS("shaders/SSDO.fs"s, GL_FRAGMENT_SHADER);
     ssdoDirect.addShader(quadVS);
     ssdoDirect.addShader(SSDOFS);
     ssdoDirect.link();
     ssdoDirect.use();
     makeSSDODirectFBO();
-    makeKernel();
+    makeKernel(KERNEL_TYPE_RANDOM);
     makeNoise();
-    glUniform1i(ssdoDirect.uniformLocation("texturePosition"), 0);
+    makeBlueNoise();
+    glUniform1i(ssdoDirect.uniformLocation("textureDepth"), 0);
     glUniform1i(ssdoDirect.uniformLocation("textureNormal"), 1);
     glUniform1i(ssdoDirect.uniformLocation("textureAlbedo"), 2);
-    glUniform1i(ssdoDirect.uniformLocation("textureLight"), 3);
     glUniform1i(ssdoDirect.uniformLocation("textureNoise"), 4);
     glUniform1i(ssdoDirect.uniformLocation("textureCubeMap"), 5);
+    glUniform1i(ssdoDirect.uniformLocation("textureEnvironment"), 7);
+    directBentNormalIndex = ssdoDirect.uniformLocation("bentNormal");
+    glUniform1i(ssdoDirect.uniformLocation("textureHDR"), 8);
+    glUniform1i(ssdoDirect.uniformLocation("envSampleCount"), envSampleCount);
+    directEnvSamplingIndex = ssdoDirect.uniformLocation("envSampling");
+    glUniform1i(ssdoDirect.uniformLocation("textureTiles"), 9);
+    directAdaptiveIndex = ssdoDirect.uniformLocation("adaptive");
+    directAdaptiveTilesIndex = ssdoDirect.uniformLocation("adaptiveTiles");
+    directCollectStatsIndex = ssdoDirect.uniformLocation("collectStats");
+    makeEnvironmentSamples();
     glUniform3fv(ssdoDirect.uniformLocation("kernel"), 64, kernel.data());
     projMatIndex = ssdoDirect.uniformLocation("projMat");
-    viewMatIndex = ssdoDirect.uniformLocation("viewMat");
+    invViewRotIndex = ssdoDirect.uniformLocation("invViewRot");
+    glUniform1i(ssdoDirect.uniformLocation("textureDepthPyramid"), 6);
     AOTypeIndex = ssdoDirect.uniformLocation("AOType");
+    directDepthPyramidIndex = ssdoDirect.uniformLocation("depthPyramid");
+    directSampling = SamplingIndex{
+        ssdoDirect.uniformLocation("sampleCount"),
+        ssdoDirect.uniformLocation("sampleOffset"),
+        ssdoDirect.uniformLocation("rotation")};
     CHECKERROR("Direct");
 
     Shader IndirectFS("shaders/indirect.fs"s, GL_FRAGMENT_SHADER);
@@ -790,23 +1863,268 @@ SSDORenderer::SSDORenderer(
     ssdoIndirect.link();
     ssdoIndirect.use();
     makeSSDOIndirectFBO();
-    glUniform1i(ssdoIndirect.uniformLocation("texturePosition"), 0);
+    glUniform1i(ssdoIndirect.uniformLocation("textureDepth"), 0);
     glUniform1i(ssdoIndirect.uniformLocation("textureNormal"), 1);
     glUniform1i(ssdoIndirect.uniformLocation("textureAlbedo"), 2);
-    glUniform1i(ssdoIndirect.uniformLocation("textureLight"), 3);
     glUniform1i(ssdoIndirect.uniformLocation("textureNoise"), 4);
     glUniform3fv(ssdoIndirect.uniformLocation("kernel"), 64, kernel.data());
+    glUniform1i(ssdoIndirect.uniformLocation("textureDepthPyramid"), 6);
     indProjMatIndex = ssdoIndirect.uniformLocation("projMat");
+    indirectDepthPyramidIndex = ssdoIndirect.uniformLocation("depthPyramid");
+    glUniform1i(ssdoIndirect.uniformLocation("textureTiles"), 9);
+    glUniform1i(ssdoIndirect.uniformLocation("textureRadiance"), 10);
+    glUniform1i(ssdoIndirect.uniformLocation("texturePatchPosition"), 11);
+    glUniform1i(ssdoIndirect.uniformLocation("texturePatchNormal"), 12);
+    glUniform1f(ssdoIndirect.uniformLocation("bounceRadius"), radianceBounceRadius);
+    indirectRadiancePyramidIndex = ssdoIndirect.uniformLocation("radiancePyramid");
+    glUniform1i(ssdoIndirect.uniformLocation("texturePrevLit"), 13);
+    glUniform1i(ssdoIndirect.uniformLocation("texturePrevDepth"), 14);
+    indirectFeedbackIndex = ssdoIndirect.uniformLocation("feedback");
+    glUniform1i(ssdoIndirect.uniformLocation("textureVoxels"), 16);
+    indirectVoxelConeIndex = ssdoIndirect.uniformLocation("voxelCone");
+    indirectViewToVoxelIndex = ssdoIndirect.uniformLocation("viewToVoxel");
+    glUniform1i(ssdoIndirect.uniformLocation("textureProbeMoments"), 17);
+    indirectProbeGridIndex = ssdoIndirect.uniformLocation("probeGrid");
+    indirectInvViewMatIndex = ssdoIndirect.uniformLocation("invViewMat");
+    indirectToPrevViewIndex = ssdoIndirect.uniformLocation("toPrevView");
+    indirectAdaptiveIndex = ssdoIndirect.uniformLocation("adaptive");
+    indirectAdaptiveTilesIndex = ssdoIndirect.uniformLocation("adaptiveTiles");
+    indirectCollectStatsIndex = ssdoIndirect.uniformLocation("collectStats");
+    indirectSampling = SamplingIndex{
+        ssdoIndirect.uniformLocation("sampleCount"),
+        ssdoIndirect.uniformLocation("sampleOffset"),
+        ssdoIndirect.uniformLocation("rotation")};
     CHECKERROR("Indirect");
 
+    Shader fusedFS("shaders/fused.fs"s, GL_FRAGMENT_SHADER);
+    fused.addShader(quadVS);
+    fused.addShader(fusedFS);
+    fused.link();
+    fused.use();
+    makeFusedFBO();
+    glUniform1i(fused.uniformLocation("textureDepth"), 0);
+    glUniform1i(fused.uniformLocation("textureNormal"), 1);
+    glUniform1i(fused.uniformLocation("textureAlbedo"), 2);
+    glUniform1i(fused.uniformLocation("textureNoise"), 4);
+    glUniform1i(fused.uniformLocation("textureCubeMap"), 5);
+    glUniform1i(fused.uniformLocation("textureEnvironment"), 7);
+    fusedBentNormalIndex = fused.uniformLocation("bentNormal");
+    glUniform3fv(fused.uniformLocation("kernel"), 64, kernel.data());
+    glUniform1f(fused.uniformLocation("radius"), fusedRadius);
+    fusedProjMatIndex = fused.uniformLocation("projMat");
+    fusedInvViewRotIndex = fused.uniformLocation("invViewRot");
+    glUniform1i(fused.uniformLocation("textureDepthPyramid"), 6);
+    fusedAOTypeIndex = fused.uniformLocation("AOType");
+    fusedDepthPyramidIndex = fused.uniformLocation("depthPyramid");
+    fusedSampling = SamplingIndex{
+        fused.uniformLocation("sampleCount"),
+        fused.uniformLocation("sampleOffset"),
+        fused.uniformLocation("rotation")};
+    CHECKERROR("Fused");
+
+    Shader gtaoFS("shaders/gtao.fs"s, GL_FRAGMENT_SHADER);
+    gtao.addShader(quadVS);
+    gtao.addShader(gtaoFS);
+    gtao.link();
+    gtao.use();
+    glUniform1i(gtao.uniformLocation("textureDepth"), 0);
+    glUniform1i(gtao.uniformLocation("textureNormal"), 1);
+    glUniform1i(gtao.uniformLocation("textureAlbedo"), 2);
+    glUniform1i(gtao.uniformLocation("textureNoise"), 4);
+    glUniform3f(gtao.uniformLocation("lightAmbient"), 1.0f, 1.0f, 1.0f);
+    gtaoProjMatIndex = gtao.uniformLocation("projMat");
+    gtaoRotationIndex = gtao.uniformLocation("rotation");
+    CHECKERROR("GTAO");
+
+    Shader tiledCS("shaders/tiled.cs"s, GL_COMPUTE_SHADER);
+    tiled.addShader(tiledCS);
+    tiled.link();
+    tiled.use();
+    glUniform1i(tiled.uniformLocation("textureDepth"), 0);
+    glUniform1i(tiled.uniformLocation("textureNormal"), 1);
+    glUniform1i(tiled.uniformLocation("textureAlbedo"), 2);
+    glUniform1i(tiled.uniformLocation("textureNoise"), 4);
+    glUniform1i(tiled.uniformLocation("textureCubeMap"), 5);
+    glUniform3fv(tiled.uniformLocation("kernel"), 64, kernel.data());
+    glUniform1f(tiled.uniformLocation("radius"), fusedRadius);
+    tiledProjMatIndex = tiled.uniformLocation("projMat");
+    tiledInvViewRotIndex = tiled.uniformLocation("invViewRot");
+    tiledAOTypeIndex = tiled.uniformLocation("AOType");
+    tiledSampling = SamplingIndex{
+        tiled.uniformLocation("sampleCount"),
+        tiled.uniformLocation("sampleOffset"),
+        tiled.uniformLocation("rotation")};
+    CHECKERROR("Tiled");
+
+    Shader temporalFS("shaders/temporal.fs"s, GL_FRAGMENT_SHADER);
+    temporal.addShader(quadVS);
+    temporal.addShader(temporalFS);
+    temporal.link();
+    temporal.use();
+    glUniform1i(temporal.uniformLocation("textureDepth"), 0);
+    glUniform1i(temporal.uniformLocation("textureNormal"), 1);
+    glUniform1i(temporal.uniformLocation("textureDirect"), 4);
+    glUniform1i(temporal.uniformLocation("textureIndirect"), 5);
+    glUniform1i(temporal.uniformLocation("historyDirect"), 6);
+    glUniform1i(temporal.uniformLocation("historyIndirect"), 7);
+    glUniform1i(temporal.uniformLocation("historyGeometry"), 8);
+    temporalInvViewMatIndex = temporal.uniformLocation("invViewMat");
+    temporalPrevViewMatIndex = temporal.uniformLocation("prevViewMat");
+    temporalProjMatIndex = temporal.uniformLocation("projMat");
+    temporalResetIndex = temporal.uniformLocation("reset");
+    CHECKERROR("Temporal");
+
+    Shader restirFS("shaders/restir.fs"s, GL_FRAGMENT_SHADER);
+    restir.addShader(quadVS);
+    restir.addShader(restirFS);
+    restir.link();
+    restir.use();
+    glUniform1i(restir.uniformLocation("textureDepth"), 0);
+    glUniform1i(restir.uniformLocation("textureNormal"), 1);
+    glUniform1i(restir.uniformLocation("textureHDR"), 8);
+    glUniform1i(restir.uniformLocation("prevReservoir"), 9);
+    glUniform1i(restir.uniformLocation("prevGeometry"), 10);
+    restirInvViewRotIndex = restir.uniformLocation("invViewRot");
+    restirProjMatIndex = restir.uniformLocation("projMat");
+    restirToPrevViewIndex = restir.uniformLocation("toPrevView");
+    restirFrameIndex = restir.uniformLocation("frame");
+    restirResetIndex = restir.uniformLocation("reset");
+    CHECKERROR("ReSTIR");
+
+    Shader restirSpatialFS("shaders/restirspatial.fs"s, GL_FRAGMENT_SHADER);
+    restirSpatial.addShader(quadVS);
+    restirSpatial.addShader(restirSpatialFS);
+    restirSpatial.link();
+    restirSpatial.use();
+    glUniform1i(restirSpatial.uniformLocation("textureDepth"), 0);
+    glUniform1i(restirSpatial.uniformLocation("textureNormal"), 1);
+    glUniform1i(restirSpatial.uniformLocation("textureHDR"), 8);
+    glUniform1i(restirSpatial.uniformLocation("textureReservoir"), 9);
+    restirSpatialInvViewRotIndex = restirSpatial.uniformLocation("invViewRot");
+    restirSpatialProjMatIndex = restirSpatial.uniformLocation("projMat");
+    restirSpatialFrameIndex = restirSpatial.uniformLocation("frame");
+    CHECKERROR("ReSTIR spatial");
+
+    Shader sdfAOFS("shaders/sdfao.fs"s, GL_FRAGMENT_SHADER);
+    sdfAO.addShader(quadVS);
+    sdfAO.addShader(sdfAOFS);
+    sdfAO.link();
+    sdfAO.use();
+    glUniform1i(sdfAO.uniformLocation("textureDepth"), 0);
+    glUniform1i(sdfAO.uniformLocation("textureNormal"), 1);
+    glUniform1i(sdfAO.uniformLocation("textureNoise"), 4);
+    glUniform1i(sdfAO.uniformLocation("textureCubeMap"), 5);
+    glUniform1i(sdfAO.uniformLocation("textureEnvironment"), 7);
+    glUniform1i(sdfAO.uniformLocation("textureDistanceField"), 15);
+    sdfAOInvViewRotIndex = sdfAO.uniformLocation("invViewRot");
+    sdfAOTypeIndex = sdfAO.uniformLocation("AOType");
+    sdfAOInstanceCountIndex = sdfAO.uniformLocation("instanceCount");
+    sdfAOStartOffsetIndex = sdfAO.uniformLocation("startOffset");
+    sdfAOTraceDistanceIndex = sdfAO.uniformLocation("traceDistance");
+    CHECKERROR("SDF AO");
+
+    Shader prtVS("shaders/prt.vs"s, GL_VERTEX_SHADER);
+    Shader prtFS("shaders/prt.fs"s, GL_FRAGMENT_SHADER);
+    prt.addShader(prtVS);
+    prt.addShader(prtFS);
+    prt.link();
+    prt.use();
+    makePRTFBO();
+    auto &environmentSH = skybox.getEnvironmentSH();
+    glUniform3fv(prt.uniformLocation("environmentSH"), 9, glm::value_ptr(environmentSH[0]));
+    prtWVPIndex = prt.uniformLocation("WVP");
+    prtAOTypeIndex = prt.uniformLocation("AOType");
+    CHECKERROR("PRT");
+
+    Shader hybridCS("shaders/hybrid.cs"s, GL_COMPUTE_SHADER);
+    hybrid.addShader(hybridCS);
+    hybrid.link();
+    hybrid.use();
+    makeHybrid();
+    glUniform1i(hybrid.uniformLocation("textureDepth"), 0);
+    glUniform1i(hybrid.uniformLocation("textureNormal"), 1);
+    glUniform1i(hybrid.uniformLocation("textureAlbedo"), 2);
+    glUniform1i(hybrid.uniformLocation("textureNoise"), 4);
+    glUniform1i(hybrid.uniformLocation("textureCubeMap"), 5);
+    glUniform3fv(hybrid.uniformLocation("kernel"), 64, kernel.data());
+    glUniform1i(hybrid.uniformLocation("sceneNodeCount"), 0);
+    hybridProjMatIndex = hybrid.uniformLocation("projMat");
+    hybridInvViewMatIndex = hybrid.uniformLocation("invViewMat");
+    hybridInvViewRotIndex = hybrid.uniformLocation("invViewRot");
+    hybridAOTypeIndex = hybrid.uniformLocation("AOType");
+    hybridCollectStatsIndex = hybrid.uniformLocation("collectStats");
+    hybridSampling = SamplingIndex{
+        hybrid.uniformLocation("sampleCount"),
+        hybrid.uniformLocation("sampleOffset"),
+        hybrid.uniformLocation("rotation")};
+    CHECKERROR("Hybrid");
+
+    Shader deinterleaveCS("shaders/deinterleave.cs"s, GL_COMPUTE_SHADER);
+    deinterleave.addShader(deinterleaveCS);
+    deinterleave.link();
+    deinterleave.use();
+    glUniform1i(deinterleave.uniformLocation("textureDepth"), 0);
+    glUniform1i(deinterleave.uniformLocation("textureNormal"), 1);
+    glUniform1i(deinterleave.uniformLocation("textureAlbedo"), 2);
+
+    Shader deinterleavedCS("shaders/deinterleaved.cs"s, GL_COMPUTE_SHADER);
+    deinterleaved.addShader(deinterleavedCS);
+    deinterleaved.link();
+    deinterleaved.use();
+    makeLayers();
+    glUniform1i(deinterleaved.uniformLocation("layerPosition"), 0);
+    glUniform1i(deinterleaved.uniformLocation("layerNormal"), 1);
+    glUniform1i(deinterleaved.uniformLocation("layerAlbedo"), 2);
+    glUniform1i(deinterleaved.uniformLocation("textureNoise"), 4);
+    glUniform1i(deinterleaved.uniformLocation("textureCubeMap"), 5);
+    glUniform3fv(deinterleaved.uniformLocation("kernel"), 64, kernel.data());
+    glUniform1f(deinterleaved.uniformLocation("radius"), fusedRadius);
+    glUniform2i(deinterleaved.uniformLocation("screenSize"), _width, _height);
+    deinterleavedProjMatIndex = deinterleaved.uniformLocation("projMat");
+    deinterleavedInvViewRotIndex = deinterleaved.uniformLocation("invViewRot");
+    deinterleavedAOTypeIndex = deinterleaved.uniformLocation("AOType");
+    deinterleavedSampling = SamplingIndex{
+        deinterleaved.uniformLocation("sampleCount"),
+        deinterleaved.uniformLocation("sampleOffset"),
+        deinterleaved.uniformLocation("rotation")};
+
+    Shader reinterleaveFS("shaders/reinterleave.fs"s, GL_FRAGMENT_SHADER);
+    reinterleave.addShader(quadVS);
+    reinterleave.addShader(reinterleaveFS);
+    reinterleave.link();
+    reinterleave.use();
+    glUniform1i(reinterleave.uniformLocation("layerDirect"), 0);
+    glUniform1i(reinterleave.uniformLocation("layerIndirect"), 1);
+    CHECKERROR("Deinterleaved");
+
+    setSampling(ssdoDirect, directSampling, 64, 0, 0.0f);
+    setSampling(fused, fusedSampling, 64, 0, 0.0f);
+    setSampling(tiled, tiledSampling, 64, 0, 0.0f);
+    setSampling(deinterleaved, deinterleavedSampling, 64, 0, 0.0f);
+    setSampling(hybrid, hybridSampling, 64, 0, 0.0f);
+    setSampling(ssdoIndirect, indirectSampling, 64, 0, 0.0f);
+
     Shader blurFS("shaders/blur.fs"s, GL_FRAGMENT_SHADER);
     blur.addShader(quadVS);
     blur.addShader(blurFS);
     blur.link();
     blur.use();
-    glUniform1i(blur.uniformLocation("textureSSAO"), 0);
+    glUniform1i(blur.uniformLocation("textureDepth"), 0);
+    glUniform1i(blur.uniformLocation("textureNormal"), 1);
+    glUniform1i(blur.uniformLocation("textureSource"), 4);
+    blurDirectionIndex = blur.uniformLocation("direction");
+    blurRadiusIndex = blur.uniformLocation("radius");
+    blurShadowMaskIndex = blur.uniformLocation("shadowMask");
     makeBlurFBO();
 
+    Shader maskFS("shaders/mask.fs"s, GL_FRAGMENT_SHADER);
+    mask.addShader(quadVS);
+    mask.addShader(maskFS);
+    mask.link();
+    mask.use();
+    glUniform1i(mask.uniformLocation("textureDepth"), 0);
+    makeMask();
+
     Shader shadowVS("shaders/shadow.vs", GL_VERTEX_SHADER);
     Shader shadowFS("shaders/shadow.fs", GL_FRAGMENT_SHADER);
     shadow.addShader(shadowVS);
@@ -823,7 +2141,7 @@ SSDORenderer::SSDORenderer(
     lighting.link();
 
     lighting.use();
-    glUniform1i(lighting.uniformLocation("texturePosition"), 0);
+    glUniform1i(lighting.uniformLocation("textureDepth"), 0);
     glUniform1i(lighting.uniformLocation("textureNormal"), 1);
     glUniform1i(lighting.uniformLocation("textureAlbedo"), 2);
     glUniform1i(lighting.uniformLocation("textureLight"), 3);
@@ -837,23 +2155,66 @@ SSDORenderer::SSDORenderer(
     lightingAOTypeIndex = lighting.uniformLocation("AOType");
     outputTypeIndex = lighting.uniformLocation("outputType");
     CHECKERROR("lighting");
-
-    Shader stencilVS("shaders/stencil.vs", GL_VERTEX_SHADER);
-    Shader stencilFS("shaders/stencil.fs", GL_FRAGMENT_SHADER);
-    stencil.addShader(stencilVS);
-    stencil.addShader(stencilFS);
-    stencil.link();
-    stencil.use();
-    stencilWVPIndex = stencil.uniformLocation("WVP");
 }
 SSDORenderer::~SSDORenderer()
 {
     glDeleteTextures(1, &noiseTexture);
+    glDeleteTextures(1, &blueNoiseTexture);
+    glDeleteTextures(1, &tileBuffer);
+    glDeleteTextures(1, &radianceBuffer);
+    glDeleteTextures(1, &patchPositionBuffer);
+    glDeleteTextures(1, &patchNormalBuffer);
+    glDeleteFramebuffers(1, &feedbackFBO);
+    glDeleteTextures(1, &feedbackBuffer);
+    glDeleteTextures(1, &feedbackDepth);
+    glDeleteFramebuffers(2, restirFBO.data());
+    glDeleteFramebuffers(2, restirSpatialFBO.data());
+    glDeleteTextures(2, restirReservoir.data());
+    glDeleteTextures(2, restirGeometry.data());
+    glDeleteTextures(1, &restirTemporalReservoir);
+    glDeleteBuffers(1, &adaptiveStatsBuffer);
+    glDeleteBuffers(1, &envSamplesUBO);
+    glDeleteTextures(1, &distanceFieldTexture);
+    glDeleteBuffers(1, &distanceFieldUBO);
+    glDeleteFramebuffers(1, &prtFBO);
+    glDeleteBuffers(1, &sceneNodesBuffer);
+    glDeleteBuffers(1, &sceneTrianglesBuffer);
+    glDeleteBuffers(1, &hybridStatsBuffer);
+    if (hybridStatsFence)
+        glDeleteSync(hybridStatsFence);
+    glDeleteQueries(2, prepassQueries.data());
+    glDeleteFramebuffers(1, &voxelFBO);
+    glDeleteTextures(1, &voxelTexture);
+    glDeleteBuffers(1, &voxelSumsBuffer);
+    glDeleteTextures(1, &whiteTexture);
+    glDeleteFramebuffers(1, &probeFBO);
+    GLuint probeBuffers[] = {probeRadianceBuffer, probeDistanceBuffer, probeDepthBuffer, probeMomentsTexture};
+    glDeleteTextures(sizeof(probeBuffers) / sizeof(GLuint), probeBuffers);
+    glDeleteBuffers(1, &probeSHBuffer);
+    glDeleteQueries(1, &probeQuery);
+    GLuint buffers[] = {directBuffer, indirectBuffer, blurBuffer, blurTmpBuffer,
+                        indirectBlurBuffer, lightBlurBuffer, shadowBuffer};
+    glDeleteTextures(sizeof(buffers) / sizeof(GLuint), buffers);
+    GLuint FBOs[] = {directFBO, indirectFBO, fusedFBO, blurFBO, blurTmpFBO,
+                     indirectBlurFBO, lightBlurFBO, shadowFBO};
+    glDeleteFramebuffers(sizeof(FBOs) / sizeof(GLuint), FBOs);
+    glDeleteTextures(2, historyDirect.data());
+    glDeleteTextures(2, historyIndirect.data());
+    glDeleteTextures(2, historyGeometry.data());
+    glDeleteFramebuffers(2, historyFBO.data());
+    GLuint layers[] = {layerPosition, layerNormal, layerAlbedo, layerDirect, layerIndirect};
+    glDeleteTextures(sizeof(layers) / sizeof(GLuint), layers);
+    glDeleteTextures(1, &depthPyramidBuffer);
+    glDeleteTextures(1, &visibilityBuffer);
+    glDeleteFramebuffers(1, &visibilityFBO);
+    glDeleteRenderbuffers(1, &maskBuffer);
+    glDeleteFramebuffers(1, &maskFBO);
 }
 void SSDORenderer::setLight(glm::vec3 lightPos, glm::vec3 lightDir) const
 {
     lighting.use();
     glUniform3f(lightPosIndex, lightPos.x, lightPos.y, lightPos.z);
+    lightPosition = lightPos;
 
     std::default_random_engine engine;
     std::normal_distribution<float> distr{0, 1};
@@ -867,8 +2228,15 @@ void SSDORenderer::setLight(glm::vec3 lightPos, glm::vec3 lightDir) const
     geometry.use();
     glUniformMatrix4fv(lightMatIndex, 1, false, glm::value_ptr(lightMat));
     glUniform3f(lightDirIndex, lightDir.x, lightDir.y, lightDir.z);
+    resolve.use();
+    glUniformMatrix4fv(resolveLightMatIndex, 1, false, glm::value_ptr(lightMat));
+    glUniform3f(resolveLightDirIndex, lightDir.x, lightDir.y, lightDir.z);
     shadow.use();
     glUniformMatrix4fv(shadowLightMatIndex, 1, false, glm::value_ptr(lightMat));
+    lightDirection = lightDir;
+    lightMatrix = lightMat;
+    voxelsValid = false;
+    probesBaked = 0;
     CHECKERROR("setLight");
 }
 void SSDORenderer::render(std::shared_ptr<Node> root, glm::mat4 proj, const Camera &camera) const
@@ -877,24 +2245,188 @@ void SSDORenderer::render(std::shared_ptr<Node> root, glm::mat4 proj, const Came
     skybox.render(viewMat, proj);
     // skybox.prepare(proj);
     shadowPass(root);
-    geometryPass(root, viewMat, proj);
-    ssdoDirectPass(viewMat, proj);
-    blurPass();
-    ssdoIndirectPass(proj);
-    stencilPass(root, viewMat, proj);
-    lightingPass(camera.center());
-}
-void SSDORenderer::geometryPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const
-{
-    geometry.use();
-    gBuffer.bindForRender();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, shadowBuffer);
-    root->draw([this, viewMat, projMat](int idx, glm::mat4 trans) {
-        geometryRender(idx, trans, viewMat, projMat);
-    });
-    gBuffer.unbind();
+    if ((mode & PASS_VOXEL_GI) && !voxelsValid)
+        voxelizePass(root);
+    if (mode & PASS_PROBES)
+        updateProbes(root);
+    if ((mode & PASS_VISIBILITY) && visibilityPass(root, viewMat, proj))
+        resolvePass(viewMat, proj);
+    else if (mode & PASS_DEPTH_PREPASS)
+    {
+        if (!prepassPending || collectDepthPrepass())
+            if (prepassFrame++ % prepassProbeInterval == 0)
+                chooseDepthPrepass(root, viewMat, proj);
+        if (usePrepass)
+            depthPrepass(root, viewMat, proj);
+        geometryPass(root, viewMat, proj, usePrepass);
+    }
+    else
+        geometryPass(root, viewMat, proj, false);
+    maskPass();
+    if (mode & PASS_DEPTH_PYRAMID)
+        depthPyramidPass();
+    if ((mode & PASS_ADAPTIVE) && (mode & PASS_ADAPTIVE_TILES))
+        classifyPass();
+    if (mode & PASS_RADIANCE_PYRAMID)
+        radiancePyramidPass(viewMat);
+
+    bool accumulate = mode & PASS_TEMPORAL;
+    int sampleCount{64};
+    int sampleOffset{0};
+    float rotation{0.0f};
+    if (accumulate)
+    {
+        // cycle through the whole kernel every 64 / temporalSampleCount frames
+        sampleCount = temporalSampleCount;
+        sampleOffset = frameIndex * temporalSampleCount % 64;
+        // wrapped so cos/sin in the shaders keep their precision
+        rotation = static_cast<float>(std::fmod(frameIndex * static_cast<double>(goldenAngle), glm::two_pi<double>()));
+        frameIndex = (frameIndex + 1) % temporalFramePeriod;
+    }
+    setSampling(ssdoDirect, directSampling, sampleCount, sampleOffset, rotation);
+    if (mode & (PASS_ENV_SAMPLING | PASS_RESTIR))
+        updateEnvironmentSamples();
+    setSampling(ssdoIndirect, indirectSampling, sampleCount, sampleOffset, rotation);
+    setSampling(fused, fusedSampling, sampleCount, sampleOffset, rotation);
+    setSampling(tiled, tiledSampling, sampleCount, sampleOffset, rotation);
+    setSampling(deinterleaved, deinterleavedSampling, sampleCount, sampleOffset, rotation);
+    setSampling(hybrid, hybridSampling, sampleCount, sampleOffset, rotation);
+    gtao.use();
+    glUniform1f(gtaoRotationIndex, rotation);
+    if ((mode & AO_TYPE_MASK) == AO_TYPE_GTAO)
+        gtaoPass(proj);
+    else if (mode & PASS_TILED)
+        tiledPass(viewMat, proj);
+    else if (mode & PASS_DEINTERLEAVED)
+        deinterleavedPass(viewMat, proj);
+    else if (mode & PASS_FUSED)
+        fusedPass(viewMat, proj);
+    else
+    {
+        bool stats = (mode & PASS_ADAPTIVE) && adaptiveFrame++ % adaptiveStatsInterval == 0;
+        if (stats)
+            beginAdaptiveStats();
+        ssdoIndirect.use();
+        glUniform1i(indirectFeedbackIndex, (mode & PASS_FEEDBACK) && feedbackValid ? 1 : 0);
+        if (mode & PASS_FEEDBACK)
+        {
+            auto toPrevView = feedbackViewMat * glm::inverse(viewMat);
+            glUniformMatrix4fv(indirectToPrevViewIndex, 1, false, glm::value_ptr(toPrevView));
+        }
+        if (mode & PASS_VOXEL_GI)
+        {
+            auto worldToVoxel = glm::translate(glm::scale(glm::identity<glm::mat4>(), glm::vec3{1.0f / voxelGridSize}), -voxelGridMin);
+            auto viewToVoxel = worldToVoxel * glm::inverse(viewMat);
+            glUniformMatrix4fv(indirectViewToVoxelIndex, 1, false, glm::value_ptr(viewToVoxel));
+        }
+        if (mode & PASS_PROBES)
+            glUniformMatrix4fv(indirectInvViewMatIndex, 1, false, glm::value_ptr(glm::inverse(viewMat)));
+        if ((mode & PASS_PRT) && (mode & AO_TYPE_MASK) != AO_TYPE_NONE)
+            prtPass(root, viewMat, proj);
+        else if ((mode & PASS_SDF_AO) && (mode & AO_TYPE_MASK) != AO_TYPE_NONE)
+            sdfAOPass(root, viewMat);
+        else if ((mode & PASS_HYBRID) && (mode & AO_TYPE_MASK) != AO_TYPE_NONE)
+            hybridPass(viewMat, proj);
+        else if ((mode & PASS_RESTIR) && (mode & AO_TYPE_MASK) == AO_TYPE_SSDO)
+            restirPass(viewMat, proj);
+        else
+            ssdoDirectPass(viewMat, proj);
+        ssdoIndirectPass(proj);
+        if (stats)
+            endAdaptiveStats();
+    }
+    if (accumulate)
+    {
+        temporalPass(viewMat, proj);
+        blurPass(historyDirect[historyIndex], blurFBO, directBlurRadius);
+        blurPass(historyIndirect[historyIndex], indirectBlurFBO, indirectBlurRadius);
+        historyIndex ^= 1;
+    }
+    else
+    {
+        blurPass(directBuffer, blurFBO, directBlurRadius);
+        blurPass(indirectBuffer, indirectBlurFBO, indirectBlurRadius);
+    }
+    blurPass(0, lightBlurFBO, lightBlurRadius);
+    lightingPass(camera.center());
+    if (mode & PASS_FEEDBACK)
+        feedbackPass(camera.center(), viewMat);
+}
+// Depth-only draw of the scene into the G-buffer, so the geometry pass that
+// follows shades each pixel once instead of every overdrawn fragment.
+void SSDORenderer::depthPrepass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    prepass.use();
+    gBuffer.bindForRender();
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    root->draw([this, viewMat, projMat](int idx, glm::mat4 trans) {
+        meshes[idx].bindPositionVAO();
+        // same association as geometryRender, so GL_EQUAL sees identical depth
+        auto WVPMat = projMat * (viewMat * trans);
+        glUniformMatrix4fv(prepassWVPIndex, 1, false, glm::value_ptr(WVPMat));
+        meshes[idx].draw();
+    });
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    gBuffer.unbind();
+    CHECKERROR("depthPrepass");
+}
+// The pre-pass only pays off with enough overdraw, so time both variants
+// on the current view. The timer results are picked up by
+// collectDepthPrepass in a later frame, the CPU never waits for them.
+void SSDORenderer::chooseDepthPrepass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    glBeginQuery(GL_TIME_ELAPSED, prepassQueries[0]);
+    geometryPass(root, viewMat, projMat, false);
+    glEndQuery(GL_TIME_ELAPSED);
+    glBeginQuery(GL_TIME_ELAPSED, prepassQueries[1]);
+    depthPrepass(root, viewMat, projMat);
+    geometryPass(root, viewMat, projMat, true);
+    glEndQuery(GL_TIME_ELAPSED);
+    prepassPending = true;
+}
+// Keeps the faster variant once both timings have arrived, returns whether
+// they had.
+bool SSDORenderer::collectDepthPrepass() const
+{
+    GLuint available{0};
+    glGetQueryObjectuiv(prepassQueries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+    GLuint64 plain{0};
+    GLuint64 prepassed{0};
+    glGetQueryObjectui64v(prepassQueries[0], GL_QUERY_RESULT, &plain);
+    glGetQueryObjectui64v(prepassQueries[1], GL_QUERY_RESULT, &prepassed);
+    if (usePrepass != (prepassed < plain))
+        std::cout << "Depth pre-pass " << (prepassed < plain ? "on" : "off")
+                  << " (" << prepassed / 1e6 << "ms vs " << plain / 1e6 << "ms)" << std::endl;
+    usePrepass = prepassed < plain;
+    prepassPending = false;
+    return true;
+}
+// With prepassed set the depth buffer already holds the visible surface and
+// only fragments matching it are shaded.
+void SSDORenderer::geometryPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat, bool prepassed) const
+{
+    geometry.use();
+    gBuffer.setProjection(projMat);
+    gBuffer.bindForRender();
+    if (prepassed)
+    {
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+    else
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, shadowBuffer);
+    root->draw([this, viewMat, projMat](int idx, glm::mat4 trans) {
+        geometryRender(idx, trans, viewMat, projMat);
+    });
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    gBuffer.unbind();
 }
 void SSDORenderer::geometryRender(int idx, glm::mat4 modelMat, glm::mat4 viewMat, glm::mat4 projMat) const
 {
@@ -925,43 +2457,555 @@ void SSDORenderer::geometryRender(int idx, glm::mat4 modelMat, glm::mat4 viewMat
     meshes[idx].draw();
     CHECKERROR("Draw Error");
 }
+// Rasterizes depth and a draw/triangle ID only; materials are shaded later
+// in resolvePass, once per visible pixel. Returns false without drawing when
+// the scene has more draws than the ID can tell apart; the caller then falls
+// back to geometryPass.
+bool SSDORenderer::visibilityPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    visibilityDraws.clear();
+    root->draw([this](int idx, glm::mat4 trans) {
+        visibilityDraws.emplace_back(idx, trans);
+    });
+    if (visibilityDraws.size() > maxVisibilityDraws)
+    {
+        visibilityDraws.clear();
+        return false;
+    }
+
+    visibility.use();
+    gBuffer.setProjection(projMat);
+    glBindFramebuffer(GL_FRAMEBUFFER, visibilityFBO);
+    const GLuint background = 0xffffffffu;
+    glClearBufferuiv(GL_COLOR, 0, &background);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    for (size_t draw = 0; draw != visibilityDraws.size(); ++draw)
+    {
+        auto idx = visibilityDraws[draw].first;
+        glUniform1ui(visibilityDrawIDIndex, static_cast<GLuint>(draw));
+        meshes[idx].bindPositionVAO();
+        auto WVPMat = projMat * viewMat * visibilityDraws[draw].second;
+        glUniformMatrix4fv(visibilityWVPIndex, 1, false, glm::value_ptr(WVPMat));
+        meshes[idx].draw();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("visibilityPass");
+    return true;
+}
+// Fills the normal and albedo targets of the G-buffer from the visibility
+// buffer: one fullscreen draw per mesh draw, each shading only its own pixels.
+void SSDORenderer::resolvePass(glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    resolve.use();
+    gBuffer.bindForRender();
+    glClear(GL_COLOR_BUFFER_BIT);
+    // depth already holds the visible surface
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, shadowBuffer);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, visibilityBuffer);
+    for (size_t draw = 0; draw != visibilityDraws.size(); ++draw)
+    {
+        auto &mesh = meshes[visibilityDraws[draw].first];
+        auto modelMat = visibilityDraws[draw].second;
+        mesh.bindStorage(1, 3, 2);
+        if (_diffuseMap)
+            mesh.bindTexture("textureDiffuse");
+        if (_normalsMap)
+            mesh.bindTexture("textureNormals");
+        glUniform1ui(resolveDrawIDIndex, static_cast<GLuint>(draw));
+        glUniformMatrix4fv(resolveModelMatIndex, 1, false, glm::value_ptr(modelMat));
+        auto WVPMat = projMat * viewMat * modelMat;
+        glUniformMatrix4fv(resolveWVPIndex, 1, false, glm::value_ptr(WVPMat));
+        glUniform1f(resolveShininessIndex, mesh.getFloatParam("shininess"));
+        quad.draw();
+    }
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_TEST);
+    gBuffer.unbind();
+    CHECKERROR("resolvePass");
+}
+// Writes 1 to the stencil mask on model pixels. The fullscreen SSDO and blur
+// passes enable the stencil test around their draws to skip the background.
+void SSDORenderer::maskPass() const
+{
+    mask.use();
+    gBuffer.bindAsTextures();
+    glBindFramebuffer(GL_FRAMEBUFFER, maskFBO);
+    glEnable(GL_STENCIL_TEST);
+    glStencilMask(0xFF);
+    glClear(GL_STENCIL_BUFFER_BIT);
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    quad.draw();
+    glStencilFunc(GL_EQUAL, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    glStencilMask(0x00);
+    glDisable(GL_STENCIL_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("maskPass");
+}
+void SSDORenderer::depthPyramidPass() const
+{
+    depthPyramid.use();
+    gBuffer.bindAsTextures();
+    int width = _width;
+    int height = _height;
+    for (int level = 0; level != depthPyramidLevels; ++level)
+    {
+        if (level)
+            glBindImageTexture(0, depthPyramidBuffer, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, depthPyramidBuffer, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glUniform1i(depthPyramidLevelIndex, level);
+        glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    CHECKERROR("depthPyramidPass");
+}
+// Lit radiance, position and normal mips for the indirect pass; level 0 needs
+// the shadow term already in the G-buffer.
+void SSDORenderer::radiancePyramidPass(glm::mat4 viewMat) const
+{
+    radiancePyramid.use();
+    gBuffer.bindAsTextures();
+    glUniformMatrix4fv(radiancePyramidViewMatIndex, 1, false, glm::value_ptr(viewMat));
+    glUniform3fv(radiancePyramidLightPosIndex, 1, glm::value_ptr(lightPosition));
+    int width = _width;
+    int height = _height;
+    for (int level = 0; level != radianceLevels; ++level)
+    {
+        if (level)
+        {
+            glBindImageTexture(0, radianceBuffer, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+            glBindImageTexture(1, patchPositionBuffer, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+            glBindImageTexture(2, patchNormalBuffer, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+        }
+        glBindImageTexture(3, radianceBuffer, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glBindImageTexture(4, patchPositionBuffer, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glBindImageTexture(5, patchNormalBuffer, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glUniform1i(radiancePyramidLevelIndex, level);
+        glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    CHECKERROR("radiancePyramidPass");
+}
+// Marks the 8x8 tiles where adaptive SSDO may need more than one batch.
+void SSDORenderer::classifyPass() const
+{
+    classify.use();
+    gBuffer.bindAsTextures();
+    glBindImageTexture(0, tileBuffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+    glDispatchCompute((_width + classifyTileSize - 1) / classifyTileSize, (_height + classifyTileSize - 1) / classifyTileSize, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    CHECKERROR("classifyPass");
+}
+void SSDORenderer::beginAdaptiveStats() const
+{
+    glClearNamedBufferData(adaptiveStatsBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    ssdoDirect.use();
+    glUniform1i(directCollectStatsIndex, 1);
+    ssdoIndirect.use();
+    glUniform1i(indirectCollectStatsIndex, 1);
+}
+// Reads the counters back, which waits for the passes, so this only runs
+// every adaptiveStatsInterval frames.
+void SSDORenderer::endAdaptiveStats() const
+{
+    ssdoDirect.use();
+    glUniform1i(directCollectStatsIndex, 0);
+    ssdoIndirect.use();
+    glUniform1i(indirectCollectStatsIndex, 0);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::array<GLuint, 4> stats;
+    glGetNamedBufferSubData(adaptiveStatsBuffer, 0, sizeof(stats), stats.data());
+    auto average = [](GLuint samples, GLuint pixels) { return pixels ? static_cast<double>(samples) / pixels : 0.0; };
+    std::cout << "Adaptive samples per pixel: direct " << average(stats[0], stats[2])
+              << " indirect " << average(stats[1], stats[3]) << std::endl;
+    CHECKERROR("endAdaptiveStats");
+}
 void SSDORenderer::ssdoDirectPass(glm::mat4 viewMat, glm::mat4 projMat) const
 {
     ssdoDirect.use();
     gBuffer.bindAsTextures();
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, depthPyramidBuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, directFBO);
     glClear(GL_COLOR_BUFFER_BIT);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, noiseTexture);
+    bindNoise(4);
     skybox.bindCubeMap(5);
+    skybox.bindEnvironment(7);
+    skybox.bindHDR(8);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_2D, tileBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, adaptiveStatsBuffer);
     glUniformMatrix4fv(projMatIndex, 1, false, glm::value_ptr(projMat));
-    glUniformMatrix4fv(viewMatIndex, 1, false, glm::value_ptr(viewMat));
+    auto invViewRot = glm::inverse(glm::mat3(viewMat));
+    glUniformMatrix3fv(invViewRotIndex, 1, false, glm::value_ptr(invViewRot));
     CHECKERROR("projMat Error");
+    glEnable(GL_STENCIL_TEST);
     quad.draw();
+    glDisable(GL_STENCIL_TEST);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 void SSDORenderer::ssdoIndirectPass(glm::mat4 projMat) const
 {
     ssdoIndirect.use();
     gBuffer.bindAsTextures();
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, depthPyramidBuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, indirectFBO);
     glClear(GL_COLOR_BUFFER_BIT);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, noiseTexture);
+    bindNoise(4);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_2D, tileBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, adaptiveStatsBuffer);
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_2D, radianceBuffer);
+    glActiveTexture(GL_TEXTURE11);
+    glBindTexture(GL_TEXTURE_2D, patchPositionBuffer);
+    glActiveTexture(GL_TEXTURE12);
+    glBindTexture(GL_TEXTURE_2D, patchNormalBuffer);
+    glActiveTexture(GL_TEXTURE13);
+    glBindTexture(GL_TEXTURE_2D, feedbackBuffer);
+    glActiveTexture(GL_TEXTURE14);
+    glBindTexture(GL_TEXTURE_2D, feedbackDepth);
+    glActiveTexture(GL_TEXTURE16);
+    glBindTexture(GL_TEXTURE_3D, voxelTexture);
+    glActiveTexture(GL_TEXTURE17);
+    glBindTexture(GL_TEXTURE_2D, probeMomentsTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, probeSHBuffer);
     glUniformMatrix4fv(indProjMatIndex, 1, false, glm::value_ptr(projMat));
     CHECKERROR("projMat Error");
+    glEnable(GL_STENCIL_TEST);
     quad.draw();
+    glDisable(GL_STENCIL_TEST);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
-void SSDORenderer::blurPass() const
+void SSDORenderer::fusedPass(glm::mat4 viewMat, glm::mat4 projMat) const
 {
-    blur.use();
-    glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
+    fused.use();
+    gBuffer.bindAsTextures();
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, depthPyramidBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, fusedFBO);
+    glClear(GL_COLOR_BUFFER_BIT);
+    bindNoise(4);
+    skybox.bindCubeMap(5);
+    skybox.bindEnvironment(7);
+    glUniformMatrix4fv(fusedProjMatIndex, 1, false, glm::value_ptr(projMat));
+    auto invViewRot = glm::inverse(glm::mat3(viewMat));
+    glUniformMatrix3fv(fusedInvViewRotIndex, 1, false, glm::value_ptr(invViewRot));
+    CHECKERROR("projMat Error");
+    glEnable(GL_STENCIL_TEST);
+    quad.draw();
+    glDisable(GL_STENCIL_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+// Writes the direct and indirect targets through the fused pass's FBO.
+void SSDORenderer::gtaoPass(glm::mat4 projMat) const
+{
+    gtao.use();
+    gBuffer.bindAsTextures();
+    glBindFramebuffer(GL_FRAMEBUFFER, fusedFBO);
+    glClear(GL_COLOR_BUFFER_BIT);
+    bindNoise(4);
+    glUniformMatrix4fv(gtaoProjMatIndex, 1, false, glm::value_ptr(projMat));
+    CHECKERROR("gtaoPass");
+    glEnable(GL_STENCIL_TEST);
+    quad.draw();
+    glDisable(GL_STENCIL_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+void SSDORenderer::tiledPass(glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    tiled.use();
+    gBuffer.bindAsTextures();
+    bindNoise(4);
+    skybox.bindCubeMap(5);
+    glBindImageTexture(0, directBuffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glBindImageTexture(1, indirectBuffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glUniformMatrix4fv(tiledProjMatIndex, 1, false, glm::value_ptr(projMat));
+    auto invViewRot = glm::inverse(glm::mat3(viewMat));
+    glUniformMatrix3fv(tiledInvViewRotIndex, 1, false, glm::value_ptr(invViewRot));
+    CHECKERROR("projMat Error");
+    glDispatchCompute((_width + tileSize - 1) / tileSize, (_height + tileSize - 1) / tileSize, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
+// Splits the G-buffer into 16 quarter-resolution layers, one per 4x4 noise
+// offset, runs SSDO per layer and interleaves the results back into the
+// direct/indirect buffers.
+void SSDORenderer::deinterleavedPass(glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    int layerWidth = (_width + 3) / 4;
+    int layerHeight = (_height + 3) / 4;
+
+    deinterleave.use();
+    gBuffer.bindAsTextures();
+    glBindImageTexture(0, layerPosition, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(1, layerNormal, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(2, layerAlbedo, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glDispatchCompute((_width + 7) / 8, (_height + 7) / 8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    deinterleaved.use();
     glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, layerPosition);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, layerNormal);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, layerAlbedo);
+    bindNoise(4);
+    skybox.bindCubeMap(5);
+    glBindImageTexture(0, layerDirect, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glBindImageTexture(1, layerIndirect, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glUniformMatrix4fv(deinterleavedProjMatIndex, 1, false, glm::value_ptr(projMat));
+    auto invViewRot = glm::inverse(glm::mat3(viewMat));
+    glUniformMatrix3fv(deinterleavedInvViewRotIndex, 1, false, glm::value_ptr(invViewRot));
+    CHECKERROR("projMat Error");
+    glDispatchCompute((layerWidth + 7) / 8, (layerHeight + 7) / 8, 16);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    reinterleave.use();
+    glBindFramebuffer(GL_FRAMEBUFFER, fusedFBO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, layerDirect);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, layerIndirect);
+    glEnable(GL_STENCIL_TEST);
+    quad.draw();
+    glDisable(GL_STENCIL_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("deinterleavedPass");
+}
+// Blends this frame's direct/indirect into the reprojected history,
+// writing history[historyIndex] from history[historyIndex ^ 1].
+void SSDORenderer::temporalPass(glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    int prev = historyIndex ^ 1;
+    temporal.use();
+    gBuffer.bindAsTextures();
+    glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[historyIndex]);
+    glActiveTexture(GL_TEXTURE4);
     glBindTexture(GL_TEXTURE_2D, directBuffer);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, indirectBuffer);
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, historyDirect[prev]);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D, historyIndirect[prev]);
+    glActiveTexture(GL_TEXTURE8);
+    glBindTexture(GL_TEXTURE_2D, historyGeometry[prev]);
+    glUniformMatrix4fv(temporalInvViewMatIndex, 1, false, glm::value_ptr(glm::inverse(viewMat)));
+    glUniformMatrix4fv(temporalPrevViewMatIndex, 1, false, glm::value_ptr(prevViewMat));
+    glUniformMatrix4fv(temporalProjMatIndex, 1, false, glm::value_ptr(projMat));
+    glUniform1i(temporalResetIndex, historyValid ? 0 : 1);
+    CHECKERROR("temporal Error");
+    quad.draw();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    prevViewMat = viewMat;
+    historyValid = true;
+}
+// Direct environment light from per-pixel reservoirs: fresh candidates plus
+// temporal reuse into restirTemporalReservoir, then spatial reuse and shading
+// into directBuffer, the result kept as next frame's history.
+void SSDORenderer::restirPass(glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    int prev = restirIndex ^ 1;
+    auto invViewRot = glm::inverse(glm::mat3(viewMat));
+    skybox.bindHDR(8);
+
+    restir.use();
+    gBuffer.bindAsTextures();
+    glBindFramebuffer(GL_FRAMEBUFFER, restirFBO[restirIndex]);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_2D, restirReservoir[prev]);
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_2D, restirGeometry[prev]);
+    glUniformMatrix3fv(restirInvViewRotIndex, 1, false, glm::value_ptr(invViewRot));
+    glUniformMatrix4fv(restirProjMatIndex, 1, false, glm::value_ptr(projMat));
+    auto toPrevView = restirViewMat * glm::inverse(viewMat);
+    glUniformMatrix4fv(restirToPrevViewIndex, 1, false, glm::value_ptr(toPrevView));
+    glUniform1i(restirFrameIndex, restirFrame);
+    glUniform1i(restirResetIndex, restirValid ? 0 : 1);
+    quad.draw();
+
+    restirSpatial.use();
+    glBindFramebuffer(GL_FRAMEBUFFER, restirSpatialFBO[restirIndex]);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_2D, restirTemporalReservoir);
+    glUniformMatrix3fv(restirSpatialInvViewRotIndex, 1, false, glm::value_ptr(invViewRot));
+    glUniformMatrix4fv(restirSpatialProjMatIndex, 1, false, glm::value_ptr(projMat));
+    glUniform1i(restirSpatialFrameIndex, restirFrame);
+    quad.draw();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("restirPass");
+
+    restirViewMat = viewMat;
+    restirValid = true;
+    restirIndex = prev;
+    ++restirFrame;
+}
+// std140 element of the DistanceFieldInstances block in shaders/sdfao.fs
+struct DistanceFieldInstance
+{
+    glm::mat4 viewToLocal;
+    // w: atlas z coordinate where the mesh's slab starts
+    glm::vec4 boxMin;
+    // w: local to view distance scale
+    glm::vec4 boxMax;
+};
+// Cone-traced AO through the distance fields of every mesh instance the
+// scene graph draws, written to the direct target. Trace lengths are in
+// voxels of the baked fields, so the cost does not depend on the
+// screen-space radius.
+void SSDORenderer::sdfAOPass(std::shared_ptr<Node> root, glm::mat4 viewMat) const
+{
+    std::vector<DistanceFieldInstance> instances;
+    float voxelSize = 0.0f;
+    float slabDepth = 1.0f / static_cast<float>(distanceFields.size());
+    root->draw([this, viewMat, slabDepth, &instances, &voxelSize](int idx, glm::mat4 modelMat) {
+        if (idx >= static_cast<int>(distanceFields.size()) || instances.size() == maxDistanceFieldInstances)
+            return;
+        auto &field = distanceFields[idx];
+        auto modelView = viewMat * modelMat;
+        // uniform scale assumed, distances are scaled by the average axis scale
+        float scale = std::cbrt(std::abs(glm::determinant(glm::mat3(modelView))));
+        instances.push_back(DistanceFieldInstance{
+            glm::inverse(modelView),
+            glm::vec4{field.getBoxMin(), idx * slabDepth},
+            glm::vec4{field.getBoxMax(), scale}});
+        float extent = field.getBoxMax().x - field.getBoxMin().x;
+        voxelSize = std::max(voxelSize, extent / field.getResolution() * scale);
+    });
+    glBindBuffer(GL_UNIFORM_BUFFER, distanceFieldUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, instances.size() * sizeof(DistanceFieldInstance), instances.data());
+    glBindBufferBase(GL_UNIFORM_BUFFER, 2, distanceFieldUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    sdfAO.use();
+    gBuffer.bindAsTextures();
+    glBindFramebuffer(GL_FRAMEBUFFER, directFBO);
     glClear(GL_COLOR_BUFFER_BIT);
+    bindNoise(4);
+    skybox.bindCubeMap(5);
+    skybox.bindEnvironment(7);
+    glActiveTexture(GL_TEXTURE15);
+    glBindTexture(GL_TEXTURE_3D, distanceFieldTexture);
+    auto invViewRot = glm::inverse(glm::mat3(viewMat));
+    glUniformMatrix3fv(sdfAOInvViewRotIndex, 1, false, glm::value_ptr(invViewRot));
+    glUniform1i(sdfAOInstanceCountIndex, static_cast<GLint>(instances.size()));
+    glUniform1f(sdfAOStartOffsetIndex, voxelSize * sdfStartVoxels);
+    glUniform1f(sdfAOTraceDistanceIndex, voxelSize * sdfTraceVoxels);
+    CHECKERROR("sdfAOPass");
+    glEnable(GL_STENCIL_TEST);
+    quad.draw();
+    glDisable(GL_STENCIL_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+// Direct term from the baked transfer: each vertex dots its coefficients
+// with the environment SH and the result is rasterized into the direct
+// target, depth-tested for equality against the G-buffer.
+void SSDORenderer::prtPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    prt.use();
+    glBindFramebuffer(GL_FRAMEBUFFER, prtFBO);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    root->draw([this, viewMat, projMat](int idx, glm::mat4 modelMat) {
+        // same association as geometryRender, so GL_EQUAL sees identical depth
+        auto WVPMat = projMat * (viewMat * modelMat);
+        glUniformMatrix4fv(prtWVPIndex, 1, false, glm::value_ptr(WVPMat));
+        meshes[idx].bindVAO();
+        meshes[idx].draw();
+    });
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("prtPass");
+}
+// Kernel-based direct term like ssdoDirectPass, with the samples the depth
+// buffer cannot answer traced through the scene BVH. Every
+// hybridStatsInterval frames the samples are counted; the counts are read
+// and the fraction of traced samples printed in a later frame, once the
+// fence after that dispatch has signalled, so the readback never stalls.
+void SSDORenderer::hybridPass(glm::mat4 viewMat, glm::mat4 projMat) const
+{
+    if (hybridStatsFence)
+    {
+        GLenum status = glClientWaitSync(hybridStatsFence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(hybridStatsFence);
+            hybridStatsFence = nullptr;
+            std::array<GLuint, 2> counts;
+            glGetNamedBufferSubData(hybridStatsBuffer, 0, sizeof(counts), counts.data());
+            double traced = counts[0] ? 100.0 * counts[1] / counts[0] : 0.0;
+            std::cout << "Hybrid samples traced in world space: " << traced << "%" << std::endl;
+        }
+    }
+    bool stats = !hybridStatsFence && hybridFrame++ % hybridStatsInterval == 0;
+    if (stats)
+        glClearNamedBufferData(hybridStatsBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    hybrid.use();
+    gBuffer.bindAsTextures();
+    bindNoise(4);
+    skybox.bindCubeMap(5);
+    glBindImageTexture(0, directBuffer, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, hybridStatsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, sceneNodesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, sceneTrianglesBuffer);
+    glUniformMatrix4fv(hybridProjMatIndex, 1, false, glm::value_ptr(projMat));
+    auto invViewMat = glm::inverse(viewMat);
+    glUniformMatrix4fv(hybridInvViewMatIndex, 1, false, glm::value_ptr(invViewMat));
+    auto invViewRot = glm::mat3(invViewMat);
+    glUniformMatrix3fv(hybridInvViewRotIndex, 1, false, glm::value_ptr(invViewRot));
+    glUniform1i(hybridCollectStatsIndex, stats ? 1 : 0);
+    CHECKERROR("hybridPass");
+    glDispatchCompute((_width + tileSize - 1) / tileSize, (_height + tileSize - 1) / tileSize, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (stats)
+        hybridStatsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+void SSDORenderer::setSampling(const Pipeline &pipeline, SamplingIndex index, int count, int offset, float rotation) const
+{
+    pipeline.use();
+    glUniform1i(index.sampleCount, count);
+    glUniform1i(index.sampleOffset, offset);
+    glUniform1f(index.rotation, rotation);
+}
+// Separable bilateral blur: horizontal into blurTmpBuffer, then vertical into targetFBO.
+// sourceBuffer == 0 blurs the shadow term of the G-buffer.
+void SSDORenderer::blurPass(GLuint sourceBuffer, GLuint targetFBO, int radius) const
+{
+    blur.use();
+    gBuffer.bindAsTextures();
+    glUniform1i(blurRadiusIndex, radius);
+    glEnable(GL_STENCIL_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, blurTmpFBO);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, sourceBuffer);
+    glUniform1i(blurShadowMaskIndex, sourceBuffer == 0);
+    glUniform2f(blurDirectionIndex, 1.0f, 0.0f);
     quad.draw();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, blurTmpBuffer);
+    glUniform1i(blurShadowMaskIndex, 0);
+    glUniform2f(blurDirectionIndex, 0.0f, 1.0f);
+    quad.draw();
+    glDisable(GL_STENCIL_TEST);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("blurPass");
 }
 void SSDORenderer::shadowPass(std::shared_ptr<Node> root) const
 {
@@ -979,7 +3023,7 @@ void SSDORenderer::shadowPass(std::shared_ptr<Node> root) const
 }
 void SSDORenderer::shadowRender(int idx, glm::mat4 modelMat) const
 {
-    meshes[idx].bindVAO();
+    meshes[idx].bindPositionVAO();
     CHECKERROR("BindVAO Error");
 
     glUniformMatrix4fv(shadowModelMatIndex, 1, false, glm::value_ptr(modelMat));
@@ -988,16 +3032,160 @@ void SSDORenderer::shadowRender(int idx, glm::mat4 modelMat) const
     meshes[idx].draw();
     CHECKERROR("Draw Error");
 }
+// Rasterizes every mesh once into the voxel grid, each triangle along its
+// dominant axis into an attachment-less viewport of voxelResolution, with
+// every fragment added to its voxel's sums. The sums are averaged into the
+// voxel texture and the mips filtered. Runs only when the voxels are stale,
+// and then rebuilds the whole grid.
+void SSDORenderer::voxelizePass(std::shared_ptr<Node> root) const
+{
+    glClearNamedBufferData(voxelSumsBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, voxelSumsBuffer);
+    voxelize.use();
+    // the program is created lazily, so the light and grid come from setLight and setScene's copies
+    glUniformMatrix4fv(voxelizeLightMatIndex, 1, false, glm::value_ptr(lightMatrix));
+    glUniform3fv(voxelizeLightPosIndex, 1, glm::value_ptr(lightPosition));
+    glUniform3fv(voxelizeLightDirIndex, 1, glm::value_ptr(lightDirection));
+    glUniform3fv(voxelizeGridMinIndex, 1, glm::value_ptr(voxelGridMin));
+    glUniform1f(voxelizeGridSizeIndex, voxelGridSize);
+    glBindFramebuffer(GL_FRAMEBUFFER, voxelFBO);
+    glViewport(0, 0, voxelResolution, voxelResolution);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, shadowBuffer);
+    if (!_diffuseMap)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, whiteTexture);
+    }
+    root->draw([this](int idx, glm::mat4 modelMat) {
+        meshes[idx].bindVAO();
+        if (_diffuseMap)
+            meshes[idx].bindTexture("textureDiffuse");
+        glUniformMatrix4fv(voxelizeModelMatIndex, 1, false, glm::value_ptr(modelMat));
+        meshes[idx].draw();
+    });
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, _width, _height);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    voxelResolve.use();
+    glBindImageTexture(0, voxelTexture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    int groups = (voxelResolution + 3) / 4;
+    glDispatchCompute(groups, groups, groups);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glGenerateTextureMipmap(voxelTexture);
+    CHECKERROR("voxelizePass");
+    voxelsValid = true;
+}
+// Bakes the next probeBakeCount probes of the current full bake, so a
+// rebake after the light changes is spread over several frames. A frame's
+// bakes are timed with a query that is read once available, and
+// probeBakeCount is resized so the bakes take about probeBudgetMs.
+void SSDORenderer::updateProbes(std::shared_ptr<Node> root) const
+{
+    if (probeQueryPending)
+    {
+        GLuint available{0};
+        glGetQueryObjectuiv(probeQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed{0};
+            glGetQueryObjectui64v(probeQuery, GL_QUERY_RESULT, &elapsed);
+            double perProbe = std::max(elapsed / 1e6 / probeQueryBaked, 1e-3);
+            probeBakeCount = std::clamp(static_cast<int>(probeBudgetMs / perProbe), 1, probeBakesPerFrame);
+            probeQueryPending = false;
+        }
+    }
+    int count = probeCounts.x * probeCounts.y * probeCounts.z;
+    if (probesBaked == count)
+        return;
+    bool timed = !probeQueryPending;
+    if (timed)
+        glBeginQuery(GL_TIME_ELAPSED, probeQuery);
+    probe.use();
+    glUniformMatrix4fv(probeLightMatIndex, 1, false, glm::value_ptr(lightMatrix));
+    glUniform3fv(probeLightPosIndex, 1, glm::value_ptr(lightPosition));
+    glUniform3fv(probeLightDirIndex, 1, glm::value_ptr(lightDirection));
+    glBindFramebuffer(GL_FRAMEBUFFER, probeFBO);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, shadowBuffer);
+    if (!_diffuseMap)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, whiteTexture);
+    }
+    // back faces must occlude, see probe.fs
+    glDisable(GL_CULL_FACE);
+    int baked = 0;
+    for (; probesBaked != count && baked != probeBakeCount; ++probesBaked, ++baked)
+        bakeProbe(root, probesBaked);
+    glEnable(GL_CULL_FACE);
+    glViewport(0, 0, _width, _height);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    if (timed)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        probeQueryPending = true;
+        probeQueryBaked = baked;
+    }
+    if (probesBaked == count)
+        std::cout << "Probes baked: " << count << std::endl;
+    CHECKERROR("updateProbes");
+}
+// Captures the lit scene around one probe into probeFBO, then probeproject.cs
+// projects the radiance onto SH like SkyBox::projectSH and the distances
+// onto the probe's octahedral tile of mean and mean squared distance. Both
+// stay on the GPU, nothing is read back.
+void SSDORenderer::bakeProbe(std::shared_ptr<Node> root, int index) const
+{
+    glm::ivec3 cell{index % probeCounts.x, index / probeCounts.x % probeCounts.y, index / (probeCounts.x * probeCounts.y)};
+    glm::vec3 probePos = probeGridMin + glm::vec3{cell} * probeSpacing;
+    auto captureProj = glm::perspective(glm::radians(90.0f), 1.0f, 0.01f * probeSpacing, probeFar);
+    GLfloat black[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    GLfloat depth = 1.0f;
+    probe.use();
+    glClearBufferfv(GL_COLOR, 0, black);
+    glClearBufferfv(GL_COLOR, 1, &probeFar);
+    glClearBufferfv(GL_DEPTH, 0, &depth);
+    glUniform3fv(probePosIndex, 1, glm::value_ptr(probePos));
+    for (int face = 0; face != 6; ++face)
+    {
+        glViewport(face * probeFaceSize, 0, probeFaceSize, probeFaceSize);
+        auto viewProj = captureProj * SkyBox::captureView(face, probePos);
+        glUniformMatrix4fv(probeViewProjIndex, 1, false, glm::value_ptr(viewProj));
+        root->draw([this](int idx, glm::mat4 modelMat) {
+            meshes[idx].bindVAO();
+            if (_diffuseMap)
+                meshes[idx].bindTexture("textureDiffuse");
+            glUniformMatrix4fv(probeModelMatIndex, 1, false, glm::value_ptr(modelMat));
+            meshes[idx].draw();
+        });
+    }
+
+    probeProject.use();
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, probeRadianceBuffer);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, probeDistanceBuffer);
+    glBindImageTexture(0, probeMomentsTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, probeSHBuffer);
+    glUniform1i(probeProjectProbeIndex, index);
+    glDispatchCompute(1, 1, 1);
+}
 void SSDORenderer::lightingPass(glm::vec3 viewPos) const
 {
     lighting.use();
     gBuffer.bindAsTextures();
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-    glStencilFunc(GL_EQUAL, 1, 0xFF);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, lightBlurBuffer);
     glActiveTexture(GL_TEXTURE4);
     glBindTexture(GL_TEXTURE_2D, blurBuffer);
     glActiveTexture(GL_TEXTURE5);
-    glBindTexture(GL_TEXTURE_2D, indirectBuffer);
+    glBindTexture(GL_TEXTURE_2D, indirectBlurBuffer);
     glUniform3f(viewPosIndex, viewPos.x, viewPos.y, viewPos.z);
 
     // glActiveTexture(GL_TEXTURE5);
@@ -1006,53 +3194,392 @@ void SSDORenderer::lightingPass(glm::vec3 viewPos) const
 
     CHECKERROR("viewPos Error");
     quad.draw();
-    glDisable(GL_STENCIL_TEST);
 }
-void SSDORenderer::stencilPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const
+// Lights the frame once more into feedbackBuffer with the full output, whatever
+// output type is on screen, and keeps the depth and view it was lit with.
+void SSDORenderer::feedbackPass(glm::vec3 viewPos, glm::mat4 viewMat) const
 {
-    stencil.use();
-    glDrawBuffer(GL_NONE);
-    glEnable(GL_STENCIL_TEST);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilMask(0xFF);
-    glClear(GL_STENCIL_BUFFER_BIT);
-    root->draw([this, viewMat, projMat](int idx, glm::mat4 trans) {
-        stencilRender(idx, trans, viewMat, projMat);
-    });
-    glDrawBuffer(GL_BACK);
-    glStencilMask(0x0);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+    glClear(GL_COLOR_BUFFER_BIT);
+    lighting.use();
+    glUniform1i(outputTypeIndex, OUTPUT_TYPE_FULL);
+    lightingPass(viewPos);
+    glUniform1i(outputTypeIndex, outputType);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glCopyImageSubData(gBuffer.getDepth(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                       feedbackDepth, GL_TEXTURE_2D, 0, 0, 0, 0, _width, _height, 1);
+    feedbackViewMat = viewMat;
+    feedbackValid = true;
+    CHECKERROR("feedbackPass");
 }
-void SSDORenderer::stencilRender(int idx, glm::mat4 modelMat, glm::mat4 viewMat, glm::mat4 projMat) const
+// Hemisphere sample (z up) from three numbers in [0, 1): a uniformly
+// distributed direction, scaled so samples crowd near the center like the
+// random kernel.
+static glm::vec3 kernelPoint(float u1, float u2, float u3)
 {
-    meshes[idx].bindVAO();
-    CHECKERROR("BindVAO Error");
-    auto WVPMat = projMat * viewMat * modelMat;
-    glUniformMatrix4fv(stencilWVPIndex, 1, false, glm::value_ptr(WVPMat));
-    CHECKERROR("WVPMat Error");
-
-    meshes[idx].draw();
-    CHECKERROR("Draw Error");
+    float r = std::sqrt(std::max(0.0f, 1.0f - u1 * u1));
+    float phi = 2.0f * glm::pi<float>() * u2;
+    return glm::vec3{r * std::cos(phi), r * std::sin(phi), u1} * (0.1f + 0.9f * u3 * u3);
 }
-
-void SSDORenderer::makeKernel()
+static float radicalInverse(unsigned base, unsigned i)
+{
+    float inverse = 1.0f / base;
+    float factor = inverse;
+    float result = 0.0f;
+    for (; i; i /= base, factor *= inverse)
+        result += (i % base) * factor;
+    return result;
+}
+// First three Sobol dimensions, direction numbers for the primitive
+// polynomials 1, x + 1 and x^2 + x + 1.
+static glm::vec3 sobolPoint(unsigned i)
+{
+    std::array<std::array<uint32_t, 32>, 3> v;
+    v[1][0] = v[2][0] = 1u << 31;
+    v[2][1] = 3u << 30;
+    for (int k = 0; k != 32; ++k)
+    {
+        v[0][k] = 1u << (31 - k);
+        if (k >= 1)
+            v[1][k] = v[1][k - 1] ^ (v[1][k - 1] >> 1);
+        if (k >= 2)
+            v[2][k] = v[2][k - 1] ^ v[2][k - 2] ^ (v[2][k - 2] >> 2);
+    }
+    glm::uvec3 x{0u};
+    for (int k = 0; i; ++k, i >>= 1)
+        if (i & 1)
+            x ^= glm::uvec3{v[0][k], v[1][k], v[2][k]};
+    return glm::vec3{x} * (1.0f / 4294967296.0f);
+}
+// Every prefix of the kernel is a well spread subset, so the sampleCount and
+// sampleOffset windows of temporal accumulation stay stratified. A nonzero
+// seed gives an independent kernel of the same type: the random kernel is
+// reseeded and the low-discrepancy ones get a random toroidal shift.
+void SSDORenderer::makeKernel(int type, unsigned seed)
 {
     std::default_random_engine engine;
     std::uniform_real_distribution<float> distr{-1.0f, 1.0f};
     std::uniform_real_distribution<float> distrz{0.0f, 1.0f};
+    glm::vec3 shift{0.0f};
+    if (seed)
+    {
+        engine.seed(seed);
+        shift = glm::vec3{distrz(engine), distrz(engine), distrz(engine)};
+    }
+    auto shifted = [shift](glm::vec3 u) { return glm::fract(u + shift); };
     // std::normal_distribution<float> distr{0, 0.2f};
     // std::normal_distribution<float> distrz{0.5f, 0.2f};
+    const float invGolden = 0.618033989f;
 
     for (int i = 0; i != 64; ++i)
     {
-        float scale = static_cast<float>(i) / 64.0f;
-        float v = 0.1f + 0.9f * scale * scale;
-        kernel[i * 3] = distr(engine) * v;
-        kernel[i * 3 + 1] = distr(engine) * v;
-        kernel[i * 3 + 2] = distrz(engine) * v;
+        glm::vec3 p;
+        switch (type)
+        {
+        case KERNEL_TYPE_HALTON:
+        {
+            auto u = shifted({radicalInverse(2, i + 1), radicalInverse(3, i + 1), radicalInverse(5, i + 1)});
+            p = kernelPoint(u.x, u.y, u.z);
+            break;
+        }
+        case KERNEL_TYPE_SOBOL:
+        {
+            auto u = shifted(sobolPoint(i + 1));
+            p = kernelPoint(u.x, u.y, u.z);
+            break;
+        }
+        case KERNEL_TYPE_FIBONACCI:
+        {
+            // 64-point spherical Fibonacci lattice visited in bit-reversed
+            // order, so the first n samples are every (64 / n)-th lattice point
+            int j = static_cast<int>(radicalInverse(2, i) * 64.0f);
+            auto u = shifted({1.0f - (j + 0.5f) / 64.0f, j * invGolden, radicalInverse(3, i + 1)});
+            p = kernelPoint(u.x, u.y, u.z);
+            break;
+        }
+        default:
+        {
+            float scale = static_cast<float>(i) / 64.0f;
+            float v = 0.1f + 0.9f * scale * scale;
+            p.x = distr(engine) * v;
+            p.y = distr(engine) * v;
+            p.z = distrz(engine) * v;
+            break;
+        }
+        }
+        kernel[i * 3] = p.x;
+        kernel[i * 3 + 1] = p.y;
+        kernel[i * 3 + 2] = p.z;
     };
+    kernelType = type;
     CHECKERROR("makeKernel");
 }
+void SSDORenderer::uploadKernel() const
+{
+    for (auto pipeline : {&ssdoDirect, &ssdoIndirect, &fused, &tiled, &deinterleaved, &hybrid})
+    {
+        pipeline->use();
+        glUniform3fv(pipeline->uniformLocation("kernel"), 64, kernel.data());
+    }
+    CHECKERROR("uploadKernel");
+}
+void SSDORenderer::makeAdaptive()
+{
+    Shader classifyCS("shaders/classify.cs"s, GL_COMPUTE_SHADER);
+    classify.addShader(classifyCS);
+    classify.link();
+    classify.use();
+    glUniform1i(classify.uniformLocation("textureDepth"), 0);
+    glUniform1i(classify.uniformLocation("textureNormal"), 1);
+
+    tileBuffer = makeTargetTexture(GL_R8UI,
+                                   (_width + classifyTileSize - 1) / classifyTileSize,
+                                   (_height + classifyTileSize - 1) / classifyTileSize);
+    glGenBuffers(1, &adaptiveStatsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, adaptiveStatsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint), NULL, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CHECKERROR("makeAdaptive");
+}
+void SSDORenderer::makeHybrid()
+{
+    glGenBuffers(1, &hybridStatsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, hybridStatsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), NULL, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CHECKERROR("makeHybrid");
+}
+// 1x1 white, the albedo the voxel and probe captures use for meshes drawn
+// without a diffuse map.
+void SSDORenderer::makeWhiteTexture()
+{
+    const GLubyte white[] = {255, 255, 255, 255};
+    glGenTextures(1, &whiteTexture);
+    glBindTexture(GL_TEXTURE_2D, whiteTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    CHECKERROR("makeWhiteTexture");
+}
+void SSDORenderer::makeVoxels()
+{
+    Shader voxelizeVS("shaders/voxelize.vs"s, GL_VERTEX_SHADER);
+    Shader voxelizeGS("shaders/voxelize.gs"s, GL_GEOMETRY_SHADER);
+    Shader voxelizeFS("shaders/voxelize.fs"s, GL_FRAGMENT_SHADER);
+    voxelize.addShader(voxelizeVS);
+    voxelize.addShader(voxelizeGS);
+    voxelize.addShader(voxelizeFS);
+    voxelize.link();
+    voxelize.use();
+    glUniform1i(voxelize.uniformLocation("textureDiffuse"), 0);
+    glUniform1i(voxelize.uniformLocation("textureShadow"), 4);
+    glUniform3f(voxelize.uniformLocation("lightDiffuse"), 1.0f, 1.0f, 1.0f);
+    glUniform1i(voxelize.uniformLocation("gridResolution"), voxelResolution);
+    voxelizeModelMatIndex = voxelize.uniformLocation("modelMat");
+    voxelizeLightMatIndex = voxelize.uniformLocation("lightMat");
+    voxelizeLightPosIndex = voxelize.uniformLocation("lightPos");
+    voxelizeLightDirIndex = voxelize.uniformLocation("lightDir");
+    voxelizeGridMinIndex = voxelize.uniformLocation("gridMin");
+    voxelizeGridSizeIndex = voxelize.uniformLocation("gridSize");
+    CHECKERROR("Voxelize");
+
+    Shader voxelResolveCS("shaders/voxelresolve.cs"s, GL_COMPUTE_SHADER);
+    voxelResolve.addShader(voxelResolveCS);
+    voxelResolve.link();
+    CHECKERROR("VoxelResolve");
+
+    if (!whiteTexture)
+        makeWhiteTexture();
+
+    int levels = 1;
+    while ((voxelResolution >> levels) > 0)
+        ++levels;
+    glGenTextures(1, &voxelTexture);
+    glBindTexture(GL_TEXTURE_3D, voxelTexture);
+    glTexStorage3D(GL_TEXTURE_3D, levels, GL_RGBA16F, voxelResolution, voxelResolution, voxelResolution);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    glGenFramebuffers(1, &voxelFBO);
+    glNamedFramebufferParameteri(voxelFBO, GL_FRAMEBUFFER_DEFAULT_WIDTH, voxelResolution);
+    glNamedFramebufferParameteri(voxelFBO, GL_FRAMEBUFFER_DEFAULT_HEIGHT, voxelResolution);
+
+    glGenBuffers(1, &voxelSumsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, voxelSumsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint) * voxelResolution * voxelResolution * voxelResolution,
+                 NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CHECKERROR("makeVoxels");
+}
+// The capture and projection programs, and six probeFaceSize faces side by
+// side: lit radiance, distance to the probe and depth.
+void SSDORenderer::makeProbes()
+{
+    Shader probeVS("shaders/probe.vs"s, GL_VERTEX_SHADER);
+    Shader probeFS("shaders/probe.fs"s, GL_FRAGMENT_SHADER);
+    probe.addShader(probeVS);
+    probe.addShader(probeFS);
+    probe.link();
+    probe.use();
+    glUniform1i(probe.uniformLocation("textureDiffuse"), 0);
+    glUniform1i(probe.uniformLocation("textureShadow"), 4);
+    glUniform3f(probe.uniformLocation("lightDiffuse"), 1.0f, 1.0f, 1.0f);
+    probeModelMatIndex = probe.uniformLocation("modelMat");
+    probeViewProjIndex = probe.uniformLocation("viewProj");
+    probePosIndex = probe.uniformLocation("probePos");
+    probeLightMatIndex = probe.uniformLocation("lightMat");
+    probeLightPosIndex = probe.uniformLocation("lightPos");
+    probeLightDirIndex = probe.uniformLocation("lightDir");
+    glGenQueries(1, &probeQuery);
+    CHECKERROR("Probe");
+
+    Shader probeProjectCS("shaders/probeproject.cs"s, GL_COMPUTE_SHADER);
+    probeProject.addShader(probeProjectCS);
+    probeProject.link();
+    probeProject.use();
+    glUniform1i(probeProject.uniformLocation("textureRadiance"), 2);
+    glUniform1i(probeProject.uniformLocation("textureDistance"), 3);
+    std::array<glm::mat3, 6> faceToWorld;
+    for (int face = 0; face != 6; ++face)
+        faceToWorld[face] = glm::transpose(glm::mat3{SkyBox::captureView(face, glm::vec3{0.0f})});
+    glUniformMatrix3fv(probeProject.uniformLocation("faceToWorld"), 6, false, glm::value_ptr(faceToWorld[0]));
+    glUniform1f(probeProject.uniformLocation("momentSharpness"), probeMomentSharpness);
+    probeProjectProbeIndex = probeProject.uniformLocation("probeIndex");
+    CHECKERROR("ProbeProject");
+
+    if (!whiteTexture)
+        makeWhiteTexture();
+
+    glGenFramebuffers(1, &probeFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, probeFBO);
+    probeRadianceBuffer = makeTargetTexture(GL_RGBA16F, 6 * probeFaceSize, probeFaceSize);
+    probeDistanceBuffer = makeTargetTexture(GL_R32F, 6 * probeFaceSize, probeFaceSize);
+    probeDepthBuffer = makeTargetTexture(GL_DEPTH_COMPONENT32F, 6 * probeFaceSize, probeFaceSize);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, probeRadianceBuffer, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, probeDistanceBuffer, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, probeDepthBuffer, 0);
+    GLenum attachments[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Probe framebuffer not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("makeProbes");
+    makeProbeGrid();
+}
+// Places the probes over the scene bounds, probeGridMax along the longest
+// axis. The grid's buffers are sized here once the probes exist, otherwise
+// by makeProbes.
+void SSDORenderer::placeProbes(glm::vec3 lo, glm::vec3 hi)
+{
+    glm::vec3 extent = hi - lo;
+    float spacing = std::max(std::max(std::max(extent.x, extent.y), extent.z), 1e-3f) / (probeGridMax - 1);
+    probeGridMin = lo;
+    probeSpacing = spacing;
+    probeCounts = glm::max(glm::ivec3{glm::ceil(extent / spacing)} + 1, glm::ivec3{2});
+    probeFar = glm::length(extent) + spacing;
+    std::cout << "Probe grid: " << probeCounts.x << "x" << probeCounts.y << "x" << probeCounts.z
+              << ", spacing " << spacing << std::endl;
+    if (probeFBO)
+        makeProbeGrid();
+}
+// Allocates the SH buffer and moment atlas for the current grid and starts
+// a full bake.
+void SSDORenderer::makeProbeGrid()
+{
+    int count = probeCounts.x * probeCounts.y * probeCounts.z;
+    probesBaked = 0;
+    // no scene placed yet
+    if (count == 0)
+        return;
+    probeTilesPerRow = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+    int tileRows = (count + probeTilesPerRow - 1) / probeTilesPerRow;
+
+    glDeleteBuffers(1, &probeSHBuffer);
+    glGenBuffers(1, &probeSHBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, probeSHBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * 9 * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32F, GL_RGBA, GL_FLOAT, NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glDeleteTextures(1, &probeMomentsTexture);
+    glGenTextures(1, &probeMomentsTexture);
+    glBindTexture(GL_TEXTURE_2D, probeMomentsTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, probeTilesPerRow * probeMomentSize, tileRows * probeMomentSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glClearTexImage(probeMomentsTexture, 0, GL_RG, GL_FLOAT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ssdoIndirect.use();
+    glUniform3fv(ssdoIndirect.uniformLocation("probeGridMin"), 1, glm::value_ptr(probeGridMin));
+    glUniform1f(ssdoIndirect.uniformLocation("probeSpacing"), probeSpacing);
+    glUniform3iv(ssdoIndirect.uniformLocation("probeCounts"), 1, glm::value_ptr(probeCounts));
+    glUniform1i(ssdoIndirect.uniformLocation("probeTilesPerRow"), probeTilesPerRow);
+    probeProject.use();
+    glUniform1i(probeProject.uniformLocation("probeTilesPerRow"), probeTilesPerRow);
+    glUniform1f(probeProject.uniformLocation("probeFar"), probeFar);
+    CHECKERROR("makeProbeGrid");
+}
+// Bakes or loads one distance field per mesh and stacks them along z in a
+// single 3D texture, as many as GL_MAX_3D_TEXTURE_SIZE allows.
+void SSDORenderer::makeDistanceFields()
+{
+    GLint maxSize{0};
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    int slabs = std::min(static_cast<int>(meshes.size()), maxSize / sdfResolution);
+    if (slabs < static_cast<int>(meshes.size()))
+        std::cerr << "Distance fields for the first " << slabs << " meshes only" << std::endl;
+    for (int i = 0; i != slabs; ++i)
+        distanceFields.emplace_back(meshes[i], sdfResolution, bakeCacheDir);
+
+    glGenTextures(1, &distanceFieldTexture);
+    glBindTexture(GL_TEXTURE_3D, distanceFieldTexture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_R16F, sdfResolution, sdfResolution, sdfResolution * slabs);
+    for (int i = 0; i != slabs; ++i)
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, i * sdfResolution, sdfResolution, sdfResolution, sdfResolution,
+                        GL_RED, GL_FLOAT, distanceFields[i].getDistances().data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    glGenBuffers(1, &distanceFieldUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, distanceFieldUBO);
+    glBufferData(GL_UNIFORM_BUFFER, maxDistanceFieldInstances * sizeof(DistanceFieldInstance), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    sdfAO.use();
+    glUniform1f(sdfAO.uniformLocation("slabDepth"), 1.0f / static_cast<float>(slabs));
+    CHECKERROR("makeDistanceFields");
+}
+void SSDORenderer::makeEnvironmentSamples()
+{
+    envSamples.resize(envPoolSize);
+    glGenBuffers(1, &envSamplesUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, envSamplesUBO);
+    glBufferData(GL_UNIFORM_BUFFER, envPoolSize * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 1, envSamplesUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    updateEnvironmentSamples();
+    CHECKERROR("makeEnvironmentSamples");
+}
+// Draws a fresh pool every frame, so accumulated frames see new directions.
+void SSDORenderer::updateEnvironmentSamples() const
+{
+    skybox.sampleEnvironment(envSamples, envEngine);
+    glBindBuffer(GL_UNIFORM_BUFFER, envSamplesUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, envSamples.size() * sizeof(glm::vec4), envSamples.data());
+    glBindBufferBase(GL_UNIFORM_BUFFER, 1, envSamplesUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
 void SSDORenderer::makeNoise()
 {
     std::default_random_engine engine;
@@ -1073,6 +3600,113 @@ void SSDORenderer::makeNoise()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     CHECKERROR("makeNoise");
 }
+// Void-and-cluster (Ulichney 1993) rank map on a torus: every rank appears
+// once and each threshold of it is an evenly spread point set, so nearby
+// texels get distant ranks. Ranks become rotation vectors around the normal.
+void SSDORenderer::makeBlueNoise()
+{
+    const int n = blueNoiseSize * blueNoiseSize;
+    const float sigma = 1.5f;
+    auto wrap = [](int d) { return std::min(std::abs(d), blueNoiseSize - std::abs(d)); };
+    std::vector<float> filter(n);
+    for (int y = 0; y != blueNoiseSize; ++y)
+        for (int x = 0; x != blueNoiseSize; ++x)
+            filter[y * blueNoiseSize + x] = std::exp(-(wrap(x) * wrap(x) + wrap(y) * wrap(y)) / (2.0f * sigma * sigma));
+
+    std::vector<char> pattern(n, 0);
+    std::vector<float> energy(n, 0.0f);
+    auto splat = [&](int p, float sign) {
+        int px = p % blueNoiseSize, py = p / blueNoiseSize;
+        for (int y = 0; y != blueNoiseSize; ++y)
+            for (int x = 0; x != blueNoiseSize; ++x)
+            {
+                int dx = (x - px + blueNoiseSize) % blueNoiseSize;
+                int dy = (y - py + blueNoiseSize) % blueNoiseSize;
+                energy[y * blueNoiseSize + x] += sign * filter[dy * blueNoiseSize + dx];
+            }
+    };
+    auto tightestCluster = [&]() {
+        int best = -1;
+        for (int p = 0; p != n; ++p)
+            if (pattern[p] && (best < 0 || energy[p] > energy[best]))
+                best = p;
+        return best;
+    };
+    auto largestVoid = [&]() {
+        int best = -1;
+        for (int p = 0; p != n; ++p)
+            if (!pattern[p] && (best < 0 || energy[p] < energy[best]))
+                best = p;
+        return best;
+    };
+
+    // initial binary pattern: random points, relaxed by moving the tightest
+    // cluster into the largest void until that puts it back
+    std::default_random_engine engine;
+    std::vector<int> order(n);
+    for (int p = 0; p != n; ++p)
+        order[p] = p;
+    std::shuffle(order.begin(), order.end(), engine);
+    int initial = n / 10;
+    for (int k = 0; k != initial; ++k)
+    {
+        pattern[order[k]] = 1;
+        splat(order[k], 1.0f);
+    }
+    for (int k = 0; k != n; ++k)
+    {
+        int cluster = tightestCluster();
+        pattern[cluster] = 0;
+        splat(cluster, -1.0f);
+        int hole = largestVoid();
+        pattern[hole] = 1;
+        splat(hole, 1.0f);
+        if (hole == cluster)
+            break;
+    }
+
+    std::vector<int> rank(n);
+    auto prototype = pattern;
+    auto prototypeEnergy = energy;
+    for (int r = initial - 1; r >= 0; --r)
+    {
+        int cluster = tightestCluster();
+        pattern[cluster] = 0;
+        splat(cluster, -1.0f);
+        rank[cluster] = r;
+    }
+    // past half the minority flips to the zeros, whose tightest cluster is
+    // the largest void of the ones on a torus, so one loop fills the rest
+    pattern = prototype;
+    energy = prototypeEnergy;
+    for (int r = initial; r != n; ++r)
+    {
+        int hole = largestVoid();
+        pattern[hole] = 1;
+        splat(hole, 1.0f);
+        rank[hole] = r;
+    }
+
+    std::vector<glm::vec3> noise(n);
+    for (int p = 0; p != n; ++p)
+    {
+        float angle = 2.0f * glm::pi<float>() * (rank[p] + 0.5f) / n;
+        noise[p] = glm::vec3{std::cos(angle), std::sin(angle), 0.0f};
+    }
+    glGenTextures(1, &blueNoiseTexture);
+    glBindTexture(GL_TEXTURE_2D, blueNoiseTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, blueNoiseSize, blueNoiseSize, 0, GL_RGB, GL_FLOAT, noise.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    CHECKERROR("makeBlueNoise");
+}
+void SSDORenderer::bindNoise(int pos) const
+{
+    glActiveTexture(GL_TEXTURE0 + pos);
+    glBindTexture(GL_TEXTURE_2D, mode & PASS_BLUE_NOISE ? blueNoiseTexture : noiseTexture);
+}
 void SSDORenderer::makeSSDODirectFBO()
 {
     glGenFramebuffers(1, &directFBO);
@@ -1107,21 +3741,194 @@ void SSDORenderer::makeSSDOIndirectFBO()
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     CHECKERROR("makeSSDOIndirectFBO");
 }
-void SSDORenderer::makeBlurFBO()
+// Renders direct and indirect into the same buffers as the separate passes.
+void SSDORenderer::makeFusedFBO()
 {
-    glGenFramebuffers(1, &blurFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
-    glGenTextures(1, &blurBuffer);
-    glBindTexture(GL_TEXTURE_2D, blurBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _width, _height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glGenFramebuffers(1, &fusedFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, fusedFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, directBuffer, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, indirectBuffer, 0);
+    unsigned int attachments[2] = {
+        GL_COLOR_ATTACHMENT0,
+        GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Framebuffer not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("makeFusedFBO");
+}
+void SSDORenderer::makeHistoryFBO()
+{
+    for (int i = 0; i != 2; ++i)
+    {
+        makeRenderTarget(historyFBO[i], historyDirect[i], GL_RGBA16F, _width, _height);
+        historyIndirect[i] = makeTargetTexture(GL_RGBA16F, _width, _height);
+        historyGeometry[i] = makeTargetTexture(GL_RGBA16F, _width, _height);
+        glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, historyIndirect[i], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, historyGeometry[i], 0);
+        unsigned int attachments[3] = {
+            GL_COLOR_ATTACHMENT0,
+            GL_COLOR_ATTACHMENT1,
+            GL_COLOR_ATTACHMENT2};
+        glDrawBuffers(3, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Framebuffer not complete!" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("makeHistoryFBO");
+}
+void SSDORenderer::makeLayers()
+{
+    int layerWidth = (_width + 3) / 4;
+    int layerHeight = (_height + 3) / 4;
+    layerPosition = makeLayeredTexture(GL_RGBA16F, layerWidth, layerHeight, 16);
+    layerNormal = makeLayeredTexture(GL_RGBA16F, layerWidth, layerHeight, 16);
+    layerAlbedo = makeLayeredTexture(GL_RGBA8, layerWidth, layerHeight, 16);
+    layerDirect = makeLayeredTexture(GL_RGBA8, layerWidth, layerHeight, 16);
+    layerIndirect = makeLayeredTexture(GL_RGBA8, layerWidth, layerHeight, 16);
+    CHECKERROR("makeLayers");
+}
+void SSDORenderer::makeDepthPyramid()
+{
+    Shader depthPyramidCS("shaders/depthpyramid.cs"s, GL_COMPUTE_SHADER);
+    depthPyramid.addShader(depthPyramidCS);
+    depthPyramid.link();
+    depthPyramid.use();
+    glUniform1i(depthPyramid.uniformLocation("textureDepth"), 0);
+    depthPyramidLevelIndex = depthPyramid.uniformLocation("level");
+
+    depthPyramidLevels = 1;
+    while ((std::max(_width, _height) >> depthPyramidLevels) > 0)
+        ++depthPyramidLevels;
+    glGenTextures(1, &depthPyramidBuffer);
+    glBindTexture(GL_TEXTURE_2D, depthPyramidBuffer);
+    glTexStorage2D(GL_TEXTURE_2D, depthPyramidLevels, GL_R32F, _width, _height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurBuffer, 0);
+    CHECKERROR("makeDepthPyramid");
+}
+void SSDORenderer::makeReservoirs()
+{
+    restirTemporalReservoir = makeTargetTexture(GL_RGBA32F, _width, _height);
+    for (int i = 0; i != 2; ++i)
+    {
+        restirReservoir[i] = makeTargetTexture(GL_RGBA32F, _width, _height);
+        restirGeometry[i] = makeTargetTexture(GL_RGBA16F, _width, _height);
+        unsigned int attachments[2] = {
+            GL_COLOR_ATTACHMENT0,
+            GL_COLOR_ATTACHMENT1};
+
+        glGenFramebuffers(1, &restirFBO[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, restirFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, restirTemporalReservoir, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, restirGeometry[i], 0);
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Framebuffer not complete!" << std::endl;
+
+        glGenFramebuffers(1, &restirSpatialFBO[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, restirSpatialFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, directBuffer, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, restirReservoir[i], 0);
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Framebuffer not complete!" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("makeReservoirs");
+}
+void SSDORenderer::makeFeedback()
+{
+    makeRenderTarget(feedbackFBO, feedbackBuffer, GL_RGBA16F, _width, _height);
+    feedbackDepth = makeTargetTexture(GL_DEPTH_COMPONENT32F, _width, _height);
+    CHECKERROR("makeFeedback");
+}
+void SSDORenderer::makeRadiancePyramid()
+{
+    Shader radiancePyramidCS("shaders/radiancepyramid.cs"s, GL_COMPUTE_SHADER);
+    radiancePyramid.addShader(radiancePyramidCS);
+    radiancePyramid.link();
+    radiancePyramid.use();
+    glUniform1i(radiancePyramid.uniformLocation("textureDepth"), 0);
+    glUniform1i(radiancePyramid.uniformLocation("textureNormal"), 1);
+    glUniform1i(radiancePyramid.uniformLocation("textureAlbedo"), 2);
+    glUniform3f(radiancePyramid.uniformLocation("lightDiffuse"), 1.0f, 1.0f, 1.0f);
+    radiancePyramidLevelIndex = radiancePyramid.uniformLocation("level");
+    radiancePyramidViewMatIndex = radiancePyramid.uniformLocation("viewMat");
+    radiancePyramidLightPosIndex = radiancePyramid.uniformLocation("lightPos");
+
+    auto makeMips = [this](GLuint &buffer, GLenum internalFormat) {
+        glGenTextures(1, &buffer);
+        glBindTexture(GL_TEXTURE_2D, buffer);
+        glTexStorage2D(GL_TEXTURE_2D, radianceLevels, internalFormat, _width, _height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    };
+    makeMips(radianceBuffer, GL_RGBA16F);
+    makeMips(patchPositionBuffer, GL_RGBA32F);
+    makeMips(patchNormalBuffer, GL_RGBA16F);
+    CHECKERROR("makeRadiancePyramid");
+}
+// 32-bit ID target sharing the G-buffer's depth attachment.
+void SSDORenderer::makeVisibilityFBO()
+{
+    glGenFramebuffers(1, &visibilityFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, visibilityFBO);
+    visibilityBuffer = makeTargetTexture(GL_R32UI, _width, _height);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, visibilityBuffer, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gBuffer.getDepth(), 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Visibility framebuffer not complete!" << std::endl;
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("makeVisibilityFBO");
+}
+void SSDORenderer::makePRTFBO()
+{
+    glGenFramebuffers(1, &prtFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, prtFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, directBuffer, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gBuffer.getDepth(), 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "PRT framebuffer not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("makePRTFBO");
+}
+void SSDORenderer::makeBlurFBO()
+{
+    makeRenderTarget(blurFBO, blurBuffer, GL_RGBA8, _width, _height);
+    makeRenderTarget(blurTmpFBO, blurTmpBuffer, GL_RGBA16F, _width, _height);
+    makeRenderTarget(indirectBlurFBO, indirectBlurBuffer, GL_RGBA8, _width, _height);
+    makeRenderTarget(lightBlurFBO, lightBlurBuffer, GL_R16F, _width, _height);
     CHECKERROR("makeBlurFBO");
 }
+// Stencil-only target shared by every fullscreen SSDO and blur framebuffer.
+// The temporal history is left unmasked, reprojection reads its background.
+void SSDORenderer::makeMask()
+{
+    glGenRenderbuffers(1, &maskBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, maskBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_STENCIL_INDEX8, _width, _height);
+
+    glGenFramebuffers(1, &maskFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, maskFBO);
+    glDrawBuffer(GL_NONE);
+    GLuint FBOs[] = {maskFBO, directFBO, indirectFBO, fusedFBO, blurFBO, blurTmpFBO,
+                     indirectBlurFBO, lightBlurFBO};
+    for (auto FBO : FBOs)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, maskBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Framebuffer not complete!" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECKERROR("makeMask");
+}
 void SSDORenderer::makeShadowFBO()
 {
     glGenFramebuffers(1, &shadowFBO);
@@ -1162,9 +3969,14 @@ void SSDORenderer::setMode(int newMode)
         std::cout << "NONE";
         ao_type = 2;
         break;
+    case AO_TYPE_GTAO:
+        std::cout << "GTAO";
+        ao_type = 3;
+        break;
     }
     output_type = mode & OUTPUT_TYPE_MASK;
-    if (output_type == OUTPUT_TYPE_FULL && ao_type != 0)
+    // GTAO's indirect target holds the colored multi-bounce term
+    if (output_type == OUTPUT_TYPE_FULL && ao_type != 0 && ao_type != 3)
         output_type = OUTPUT_TYPE_DIRECT;
     std::cout << " ";
     switch (output_type)
@@ -1182,18 +3994,375 @@ void SSDORenderer::setMode(int newMode)
         std::cout << "AO Value";
         break;
     }
+    if (mode & PASS_FUSED)
+        std::cout << " Fused";
+    if (mode & PASS_TILED)
+        std::cout << " Tiled";
+    if (mode & PASS_DEINTERLEAVED)
+        std::cout << " Deinterleaved";
+    if (mode & PASS_TEMPORAL)
+        std::cout << " Temporal";
+    if (mode & PASS_DEPTH_PYRAMID)
+        std::cout << " DepthPyramid";
+    if (mode & PASS_VISIBILITY)
+        std::cout << " Visibility";
+    if (mode & PASS_DEPTH_PREPASS)
+        std::cout << " DepthPrepass";
+    if (mode & PASS_BENT_NORMAL)
+        std::cout << " BentNormal";
+    if (mode & PASS_ENV_SAMPLING)
+        std::cout << (skybox.canSampleEnvironment() ? " EnvSampling" : " EnvSampling (no usable HDR, kernel)");
+    switch (mode & KERNEL_TYPE_MASK)
+    {
+    case KERNEL_TYPE_HALTON:
+        std::cout << " Halton";
+        break;
+    case KERNEL_TYPE_SOBOL:
+        std::cout << " Sobol";
+        break;
+    case KERNEL_TYPE_FIBONACCI:
+        std::cout << " Fibonacci";
+        break;
+    }
+    if (mode & PASS_BLUE_NOISE)
+        std::cout << " BlueNoise";
+    if (mode & PASS_ADAPTIVE)
+        std::cout << " Adaptive";
+    if ((mode & PASS_ADAPTIVE) && (mode & PASS_ADAPTIVE_TILES))
+        std::cout << " AdaptiveTiles";
+    if (mode & PASS_RADIANCE_PYRAMID)
+        std::cout << " RadiancePyramid";
+    if (mode & PASS_FEEDBACK)
+        std::cout << " Feedback";
+    if (mode & PASS_RESTIR)
+        std::cout << " ReSTIR";
+    if (mode & PASS_SDF_AO)
+        std::cout << " SDFAO";
+    if (mode & PASS_PRT)
+        std::cout << " PRT";
+    if (mode & PASS_HYBRID)
+        std::cout << " Hybrid";
+    if (mode & PASS_VOXEL_GI)
+        std::cout << " VoxelGI";
+    if (mode & PASS_PROBES)
+        std::cout << " Probes";
+    feedbackValid = false;
+    restirValid = false;
+    adaptiveFrame = 0;
+    hybridFrame = 0;
+    if ((mode & KERNEL_TYPE_MASK) != kernelType)
+    {
+        makeKernel(mode & KERNEL_TYPE_MASK);
+        uploadKernel();
+    }
+    prepassFrame = 0;
+    historyValid = false;
     std::cout << endl;
+    // allocated the first time their mode is set, so renderers that never
+    // use a mode, like the benchmark's, skip its resources
+    if ((mode & PASS_TEMPORAL) && !historyFBO[0])
+        makeHistoryFBO();
+    if ((mode & PASS_DEPTH_PYRAMID) && !depthPyramidBuffer)
+        makeDepthPyramid();
+    if ((mode & PASS_ADAPTIVE) && !tileBuffer)
+        makeAdaptive();
+    if ((mode & PASS_RADIANCE_PYRAMID) && !radianceBuffer)
+        makeRadiancePyramid();
+    if ((mode & PASS_FEEDBACK) && !feedbackFBO)
+        makeFeedback();
+    if ((mode & PASS_RESTIR) && !restirFBO[0])
+        makeReservoirs();
+    if ((mode & PASS_SDF_AO) && distanceFields.empty())
+        makeDistanceFields();
+    if ((mode & PASS_VOXEL_GI) && !voxelTexture)
+        makeVoxels();
+    if ((mode & PASS_PROBES) && !probeFBO)
+        makeProbes();
     ssdoDirect.use();
     glUniform1i(AOTypeIndex, ao_type);
+    fused.use();
+    glUniform1i(fusedAOTypeIndex, ao_type);
+    tiled.use();
+    glUniform1i(tiledAOTypeIndex, ao_type);
+    deinterleaved.use();
+    glUniform1i(deinterleavedAOTypeIndex, ao_type);
+    sdfAO.use();
+    glUniform1i(sdfAOTypeIndex, ao_type);
+    prt.use();
+    glUniform1i(prtAOTypeIndex, ao_type);
+    hybrid.use();
+    glUniform1i(hybridAOTypeIndex, ao_type);
+    int pyramid = mode & PASS_DEPTH_PYRAMID ? 1 : 0;
+    ssdoDirect.use();
+    glUniform1i(directDepthPyramidIndex, pyramid);
+    ssdoIndirect.use();
+    glUniform1i(indirectDepthPyramidIndex, pyramid);
+    fused.use();
+    glUniform1i(fusedDepthPyramidIndex, pyramid);
+    int bent = mode & PASS_BENT_NORMAL ? 1 : 0;
+    ssdoDirect.use();
+    glUniform1i(directBentNormalIndex, bent);
+    fused.use();
+    glUniform1i(fusedBentNormalIndex, bent);
+    ssdoDirect.use();
+    // without a usable HDR map the cosine-weighted kernel stands in
+    glUniform1i(directEnvSamplingIndex, (mode & PASS_ENV_SAMPLING) && skybox.canSampleEnvironment() ? 1 : 0);
+    int adaptive = mode & PASS_ADAPTIVE ? 1 : 0;
+    int adaptiveTiles = adaptive && (mode & PASS_ADAPTIVE_TILES) ? 1 : 0;
+    glUniform1i(directAdaptiveIndex, adaptive);
+    glUniform1i(directAdaptiveTilesIndex, adaptiveTiles);
+    ssdoIndirect.use();
+    glUniform1i(indirectAdaptiveIndex, adaptive);
+    glUniform1i(indirectAdaptiveTilesIndex, adaptiveTiles);
+    glUniform1i(indirectRadiancePyramidIndex, mode & PASS_RADIANCE_PYRAMID ? 1 : 0);
+    glUniform1i(indirectVoxelConeIndex, mode & PASS_VOXEL_GI ? 1 : 0);
+    glUniform1i(indirectProbeGridIndex, mode & PASS_PROBES ? 1 : 0);
     lighting.use();
     glUniform1i(lightingAOTypeIndex, ao_type);
     glUniform1i(outputTypeIndex, output_type);
+    outputType = output_type;
+}
+// Average GPU time of the SSDO passes on one G-buffer of this renderer's resolution.
+void SSDORenderer::benchmark(std::shared_ptr<Node> root, glm::mat4 proj, const Camera &camera, int iterations) const
+{
+    auto viewMat = camera.getTransMat();
+    shadowPass(root);
+    auto geometryTime = timeGPU([this, root, viewMat, proj]() { geometryPass(root, viewMat, proj, false); }, iterations);
+    auto prepassTime = timeGPU([this, root, viewMat, proj]() {
+        depthPrepass(root, viewMat, proj);
+        geometryPass(root, viewMat, proj, true);
+    }, iterations);
+    auto visibilityTime = timeGPU([this, root, viewMat, proj]() {
+        if (visibilityPass(root, viewMat, proj))
+            resolvePass(viewMat, proj);
+        else
+            geometryPass(root, viewMat, proj, false);
+    }, iterations);
+    std::cout << _width << "x" << _height
+              << " geometry: " << geometryTime << "ms"
+              << " pre-pass + geometry: " << prepassTime << "ms"
+              << " visibility + resolve: " << visibilityTime << "ms" << std::endl;
+
+    maskPass();
+    auto separatePasses = [this, viewMat, proj]() {
+        ssdoDirectPass(viewMat, proj);
+        ssdoIndirectPass(proj);
+    };
+    auto separate = timeGPU(separatePasses, iterations);
+    auto fusedTime = timeGPU([this, viewMat, proj]() { fusedPass(viewMat, proj); }, iterations);
+    auto tiledTime = timeGPU([this, viewMat, proj]() { tiledPass(viewMat, proj); }, iterations);
+    auto deinterleavedTime = timeGPU([this, viewMat, proj]() { deinterleavedPass(viewMat, proj); }, iterations);
+    auto gtaoTime = timeGPU([this, proj]() { gtaoPass(proj); }, iterations);
+    std::cout << _width << "x" << _height
+              << " separate: " << separate << "ms"
+              << " fused: " << fusedTime << "ms"
+              << " tiled: " << tiledTime << "ms"
+              << " deinterleaved: " << deinterleavedTime << "ms"
+              << " GTAO: " << gtaoTime << "ms" << std::endl;
+
+    // bent-normal direct light against the per-sample cubemap fetches it replaces
+    auto readDirect = [this]() {
+        std::vector<float> pixels(4 * _width * _height);
+        glGetTextureImage(directBuffer, 0, GL_RGBA, GL_FLOAT, static_cast<GLsizei>(pixels.size() * sizeof(float)), pixels.data());
+        return pixels;
+    };
+    auto directPass = [this, viewMat, proj]() { ssdoDirectPass(viewMat, proj); };
+    ssdoDirect.use();
+    glUniform1i(directBentNormalIndex, 0);
+    auto perSampleTime = timeGPU(directPass, iterations);
+    auto reference = readDirect();
+    ssdoDirect.use();
+    glUniform1i(directBentNormalIndex, 1);
+    auto bentTime = timeGPU(directPass, iterations);
+    auto bent = readDirect();
+    ssdoDirect.use();
+    glUniform1i(directBentNormalIndex, mode & PASS_BENT_NORMAL ? 1 : 0);
+    float maxError{0.0f};
+    double sumError{0.0};
+    for (size_t i = 0; i != reference.size(); ++i)
+    {
+        if (i % 4 == 3)
+            continue;
+        float error = std::abs(reference[i] - bent[i]);
+        maxError = std::max(maxError, error);
+        sumError += error;
+    }
+    std::cout << _width << "x" << _height
+              << " direct per-sample: " << perSampleTime << "ms"
+              << " bent normal: " << bentTime << "ms"
+              << " mean error: " << sumError / (reference.size() / 4 * 3)
+              << " max error: " << maxError << std::endl;
+}
+// For every kernel and noise texture, the smallest sample count whose blurred
+// direct term is as close to its reference as the random kernel with white
+// noise gets at 64 samples. Each kernel type is measured against the mean of
+// referenceSampleCount samples drawn from independently seeded kernels of
+// that same type, so the error is variance and not a difference between
+// sample distributions. That mean is in turn compared with a ground truth
+// shared by all types, which measures each type's bias.
+void SSDORenderer::tuneSampleCount(std::shared_ptr<Node> root, glm::mat4 proj, const Camera &camera)
+{
+    auto viewMat = camera.getTransMat();
+    shadowPass(root);
+    geometryPass(root, viewMat, proj, false);
+    maskPass();
+
+    std::vector<float> depth(_width * _height);
+    glGetTextureImage(gBuffer.getDepth(), 0, GL_DEPTH_COMPONENT, GL_FLOAT, static_cast<GLsizei>(depth.size() * sizeof(float)), depth.data());
+    auto renderDirect = [this, viewMat, proj](int count) {
+        setSampling(ssdoDirect, directSampling, count, 0, 0.0f);
+        ssdoDirectPass(viewMat, proj);
+        blurPass(directBuffer, blurFBO, directBlurRadius);
+        std::vector<float> pixels(4 * _width * _height);
+        glGetTextureImage(blurBuffer, 0, GL_RGBA, GL_FLOAT, static_cast<GLsizei>(pixels.size() * sizeof(float)), pixels.data());
+        return pixels;
+    };
+
+    // reference: independently seeded kernels of one type, 64 samples each, averaged
+    auto makeReference = [this, &renderDirect](int type) {
+        setMode(AO_TYPE_SSDO | OUTPUT_TYPE_DIRECT | type);
+        const int batches = referenceSampleCount / 64;
+        std::vector<float> reference(4 * _width * _height, 0.0f);
+        for (int batch = 0; batch != batches; ++batch)
+        {
+            makeKernel(type, referenceSeedSalt + batch);
+            uploadKernel();
+            auto pixels = renderDirect(64);
+            for (size_t k = 0; k != reference.size(); ++k)
+                reference[k] += pixels[k] / batches;
+        }
+        makeKernel(type);
+        uploadKernel();
+        return reference;
+    };
+    // ground truth: kernelPoint over independent uniform samples, the integral
+    // the shifted low-discrepancy kernels stratify
+    auto makeGroundTruth = [this, &renderDirect]() {
+        setMode(AO_TYPE_SSDO | OUTPUT_TYPE_DIRECT | KERNEL_TYPE_RANDOM);
+        std::default_random_engine engine{referenceSeedSalt - 1};
+        std::uniform_real_distribution<float> distr{0.0f, 1.0f};
+        const int batches = groundTruthSampleCount / 64;
+        std::vector<float> truth(4 * _width * _height, 0.0f);
+        for (int batch = 0; batch != batches; ++batch)
+        {
+            for (int i = 0; i != 64; ++i)
+            {
+                auto p = kernelPoint(distr(engine), distr(engine), distr(engine));
+                kernel[i * 3] = p.x;
+                kernel[i * 3 + 1] = p.y;
+                kernel[i * 3 + 2] = p.z;
+            }
+            uploadKernel();
+            auto pixels = renderDirect(64);
+            for (size_t k = 0; k != truth.size(); ++k)
+                truth[k] += pixels[k] / batches;
+        }
+        makeKernel(KERNEL_TYPE_RANDOM);
+        uploadKernel();
+        return truth;
+    };
+    auto rmse = [&depth](const std::vector<float> &pixels, const std::vector<float> &reference) {
+        double sum{0.0};
+        size_t count{0};
+        for (size_t p = 0; p != depth.size(); ++p)
+        {
+            if (depth[p] == 1.0f)
+                continue;
+            for (int c = 0; c != 3; ++c)
+            {
+                double error = pixels[4 * p + c] - reference[4 * p + c];
+                sum += error * error;
+            }
+            count += 3;
+        }
+        return count ? std::sqrt(sum / count) : 0.0;
+    };
+    const std::array<std::pair<int, const char *>, 4> kernels = {
+        std::make_pair(KERNEL_TYPE_RANDOM, "random"),
+        std::make_pair(KERNEL_TYPE_HALTON, "Halton"),
+        std::make_pair(KERNEL_TYPE_SOBOL, "Sobol"),
+        std::make_pair(KERNEL_TYPE_FIBONACCI, "Fibonacci")};
+    auto truth = makeGroundTruth();
+    std::vector<std::string> results;
+    double target{0.0};
+    for (auto &k : kernels)
+    {
+        auto reference = makeReference(k.first);
+        results.push_back(std::string(k.second) + " bias against the ground truth: " + std::to_string(rmse(reference, truth)));
+        // kernels[0] is the random kernel, which sets the target
+        if (k.first == KERNEL_TYPE_RANDOM)
+            target = rmse(renderDirect(64), reference);
+        for (int noise : {0, PASS_BLUE_NOISE})
+        {
+            setMode(AO_TYPE_SSDO | OUTPUT_TYPE_DIRECT | k.first | noise);
+            std::string result = std::string(k.second) + (noise ? " + blue noise: " : " + white noise: ");
+            int count = 4;
+            double error = rmse(renderDirect(count), reference);
+            for (; error > target && count < 64; error = rmse(renderDirect(count), reference))
+                count += 4;
+            result += (error > target ? "> 64" : std::to_string(count)) + " samples (error " + std::to_string(error) + ")";
+            results.push_back(result);
+        }
+    }
+    std::cout << "Target error (random kernel, white noise, 64 samples): " << target << std::endl;
+    for (auto &result : results)
+        std::cout << result << std::endl;
 }
 void SSDORenderer::setProj(glm::mat4 projMat)
 {
     skybox.prepare(projMat);
     _projMat = projMat;
 }
+// Builds the world-space BVH that PASS_HYBRID traces from every mesh
+// placement of the scene graph and uploads it to shader storage, and fits
+// the PASS_VOXEL_GI grid and PASS_PROBES grid around the same triangles.
+// The scene is static, so this runs once at load from the Scene
+// constructor.
+void SSDORenderer::setScene(std::shared_ptr<Node> root)
+{
+    std::vector<glm::vec3> triangles;
+    glm::vec3 lo{std::numeric_limits<float>::max()};
+    glm::vec3 hi{-std::numeric_limits<float>::max()};
+    root->draw([this, &triangles, &lo, &hi](int idx, glm::mat4 modelMat) {
+        auto &vertices = meshes[idx].getVertices();
+        for (auto i : meshes[idx].getIndices())
+        {
+            triangles.push_back(glm::vec3{modelMat * glm::vec4{vertices[i].position, 1.0f}});
+            lo = glm::min(lo, triangles.back());
+            hi = glm::max(hi, triangles.back());
+        }
+    });
+    if (!triangles.empty())
+    {
+        // PASS_VOXEL_GI covers the scene with a cube, one voxel of margin
+        voxelGridSize = std::max(std::max(hi.x - lo.x, hi.y - lo.y), hi.z - lo.z) *
+                        (1.0f + 2.0f / voxelResolution);
+        voxelGridMin = (lo + hi) * 0.5f - glm::vec3{voxelGridSize * 0.5f};
+        voxelsValid = false;
+        placeProbes(lo, hi);
+    }
+    BVH bvh(std::move(triangles));
+    auto &nodes = bvh.getNodes();
+    std::vector<glm::vec4> packed;
+    packed.reserve(bvh.getTriangles().size());
+    for (auto &v : bvh.getTriangles())
+        packed.emplace_back(v, 0.0f);
+    std::cout << "Scene BVH: " << nodes.size() << " nodes, " << packed.size() / 3 << " triangles" << std::endl;
+
+    glDeleteBuffers(1, &sceneNodesBuffer);
+    glDeleteBuffers(1, &sceneTrianglesBuffer);
+    glGenBuffers(1, &sceneNodesBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneNodesBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(nodes.size(), 1) * sizeof(BVHNode), nodes.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &sceneTrianglesBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneTrianglesBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(packed.size(), 1) * sizeof(glm::vec4), packed.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    hybrid.use();
+    glUniform1i(hybrid.uniformLocation("sceneNodeCount"), static_cast<GLint>(nodes.size()));
+    CHECKERROR("setScene");
+}
 
 Scene::Scene(const aiScene *scene, const std::string &directory) : ai_scene(scene), dir(directory)
 {
@@ -1207,11 +4376,12 @@ Scene::Scene(const aiScene *scene, const std::string &directory) : ai_scene(scen
 
     // renderer = make_unique<BaselineRenderer>(meshes, true, true, true, false, "baseline_tangent.vs", "baseline_normals.fs");
     renderer = make_unique<SSDORenderer>(meshes, 1600, 900, true, false, true, false);
-    renderer->setLight(glm::vec3{50.0f, -100.0f, 100.0f}, glm::vec3{-0.5f, 1.0f, -1.0f});
+    renderer->setLight(sceneLightPos, sceneLightDir);
     renderer->setProj(glm::perspective(
         glm::radians(45.0f),
         static_cast<float>(1600) / static_cast<float>(900),
         0.1f, 500.0f));
+    renderer->setScene(root);
 }
 Scene::~Scene()
 {
@@ -1225,8 +4395,64 @@ void Scene::render(glm::mat4 proj, const Camera &camera) const
 }
 void Scene::setMode(int newMode)
 {
+    if ((newMode & PASS_PRT) && !transferBaked)
+        bakeTransfer();
     renderer->setMode(newMode);
 }
+// Bakes every mesh's transfer for the rotation of its first placement in
+// the scene graph. The meshes are static, further placements reuse it.
+void Scene::bakeTransfer()
+{
+    std::vector<glm::mat3> rotations(meshes.size(), glm::mat3{1.0f});
+    std::vector<bool> placed(meshes.size(), false);
+    root->draw([&rotations, &placed](int idx, glm::mat4 modelMat) {
+        if (placed[idx])
+            return;
+        placed[idx] = true;
+        glm::mat3 m{modelMat};
+        rotations[idx] = glm::mat3{glm::normalize(m[0]), glm::normalize(m[1]), glm::normalize(m[2])};
+    });
+    for (size_t i = 0; i != meshes.size(); ++i)
+        meshes[i].setTransfer(RadianceTransfer(meshes[i], rotations[i], bakeCacheDir).getCoefficients());
+    transferBaked = true;
+}
+void Scene::benchmark(const Camera &camera) const
+{
+    const std::array<glm::ivec2, 4> resolutions = {
+        glm::ivec2{1280, 720},
+        glm::ivec2{1600, 900},
+        glm::ivec2{1920, 1080},
+        glm::ivec2{3840, 2160}};
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    for (auto &res : resolutions)
+    {
+        auto proj = glm::perspective(
+            glm::radians(45.0f),
+            static_cast<float>(res.x) / static_cast<float>(res.y),
+            0.1f, 500.0f);
+        SSDORenderer bench(meshes, res.x, res.y, true, false, true, false);
+        bench.setLight(sceneLightPos, sceneLightDir);
+        bench.setProj(proj);
+        bench.benchmark(root, proj, camera, 20);
+    }
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+void Scene::tuneSampleCount(const Camera &camera) const
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    auto proj = glm::perspective(
+        glm::radians(45.0f),
+        static_cast<float>(1600) / static_cast<float>(900),
+        0.1f, 500.0f);
+    SSDORenderer tuner(meshes, 1600, 900, true, false, true, false);
+    tuner.setLight(sceneLightPos, sceneLightDir);
+    tuner.setProj(proj);
+    tuner.tuneSampleCount(root, proj, camera);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
 
 std::map<std::string, Texture> Scene::loadMaterialTexures(unsigned int index)
 {
@@ -1268,6 +4494,77 @@ MaterialParams Scene::loadMaterialParams(unsigned int index)
     return result;
 }
 
+GPUTimer::GPUTimer(GLuint query, int iterations)
+    : _query(query), _iterations(iterations)
+{
+}
+GPUTimer::GPUTimer(GPUTimer &&otherTimer)
+    : _query(otherTimer._query), _iterations(otherTimer._iterations)
+{
+    otherTimer._query = 0;
+}
+GPUTimer::~GPUTimer() noexcept
+{
+    if (_query)
+        glDeleteQueries(1, &_query);
+}
+double GPUTimer::milliseconds() const
+{
+    GLuint64 elapsed{0};
+    glGetQueryObjectui64v(_query, GL_QUERY_RESULT, &elapsed);
+    return elapsed / 1e6 / _iterations;
+}
+std::ostream &operator<<(std::ostream &os, const GPUTimer &timer)
+{
+    return os << timer.milliseconds();
+}
+GPUTimer timeGPU(std::function<void()> func, int iterations)
+{
+    GLuint query;
+    glGenQueries(1, &query);
+    func();
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    for (int i = 0; i != iterations; ++i)
+        func();
+    glEndQuery(GL_TIME_ELAPSED);
+    return GPUTimer(query, iterations);
+}
+// Immutable storage, so internalFormat must be a sized format.
+GLuint makeTargetTexture(GLint internalFormat, int width, int height)
+{
+    assert(internalFormat != GL_RED && internalFormat != GL_RG && internalFormat != GL_RGB &&
+           internalFormat != GL_RGBA && internalFormat != GL_DEPTH_COMPONENT);
+    GLuint buffer;
+    glGenTextures(1, &buffer);
+    glBindTexture(GL_TEXTURE_2D, buffer);
+    glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return buffer;
+}
+GLuint makeLayeredTexture(GLint internalFormat, int width, int height, int layers)
+{
+    GLuint buffer;
+    glGenTextures(1, &buffer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, buffer);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, internalFormat, width, height, layers);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return buffer;
+}
+void makeRenderTarget(GLuint &FBO, GLuint &buffer, GLint internalFormat, int width, int height)
+{
+    glGenFramebuffers(1, &FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    buffer = makeTargetTexture(internalFormat, width, height);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, buffer, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 GLuint TextureFromFile(const std::string &path, const std::string &directory, bool gamma)
 {
     auto filename = directory + '/' + path;
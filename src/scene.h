@@ -3,9 +3,12 @@
 #define SCENE_H
 
 #include <array>
+#include <cstdint>
 #include <functional>
+#include <iosfwd>
 #include <map>
 #include <memory>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -64,6 +67,15 @@ struct Vertex
     glm::vec3 bitangent;
 };
 
+// Everything but the position, which has its own buffer, see Mesh::setup
+struct VertexAttributes
+{
+    glm::vec3 normal;
+    glm::vec2 texCoords;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+};
+
 struct Texture
 {
     GLuint id;
@@ -102,8 +114,13 @@ public:
     ~Mesh();
 
     void bindVAO() const;
+    void bindPositionVAO() const;
+    void bindStorage(GLuint positionBinding, GLuint attributeBinding, GLuint indexBinding) const;
     void bindTexture(const std::string &name) const;
     float getFloatParam(const std::string &name) const;
+    const std::vector<Vertex> &getVertices() const noexcept;
+    const std::vector<unsigned int> &getIndices() const noexcept;
+    void setTransfer(const std::vector<float> &coefficients);
     void draw() const;
 
 private:
@@ -114,8 +131,86 @@ private:
     std::map<std::string, Texture> textures;
     MaterialParams params;
     GLuint VAO{0};
+    GLuint positionVAO{0};
+    GLuint positionVBO{0};
     GLuint VBO{0};
     GLuint EBO{0};
+    // PRT coefficients, attributes 5-7, see setTransfer
+    GLuint transferVBO{0};
+};
+
+// Signed distance to a mesh on a regular grid over its padded bounding
+// cube, in mesh-local units and negative inside. Baked on the CPU the first
+// time and cached on disk under a hash of the triangles.
+class DistanceField
+{
+public:
+    DistanceField(const Mesh &mesh, int resolution, const std::string &cacheDir);
+
+    int getResolution() const noexcept;
+    glm::vec3 getBoxMin() const noexcept;
+    glm::vec3 getBoxMax() const noexcept;
+    const std::vector<float> &getDistances() const noexcept;
+
+private:
+    void bake(const std::vector<glm::vec3> &triangles);
+    bool load(const std::string &file, std::uint64_t key);
+    void save(const std::string &file, std::uint64_t key) const;
+
+    int resolution;
+    glm::vec3 boxMin;
+    glm::vec3 boxMax;
+    std::vector<float> distances;
+};
+
+// Depth-first layout: an inner node's left child follows it and its right
+// child is at offset; a leaf holds count triangles from offset on.
+struct BVHNode
+{
+    glm::vec3 boundsMin;
+    int offset;
+    glm::vec3 boundsMax;
+    int count;
+};
+
+// Bounding volume hierarchy over a triangle list (three positions per
+// triangle), built with the binned surface area heuristic. The triangles
+// are reordered so every leaf's are contiguous, and kept a second time as
+// separate vertex and edge streams for the 4-wide ray-triangle test.
+class BVH
+{
+public:
+    BVH(std::vector<glm::vec3> triangles);
+
+    bool occluded(glm::vec3 origin, glm::vec3 dir, float tMax) const;
+    const std::vector<BVHNode> &getNodes() const noexcept;
+    const std::vector<glm::vec3> &getTriangles() const noexcept;
+
+private:
+    int build(std::vector<BVHNode> &out, std::vector<int> &order, const std::vector<glm::vec3> &centroids,
+              int begin, int end, int depth) const;
+
+    std::vector<BVHNode> nodes;
+    std::vector<glm::vec3> triangles;
+    // a.xyz, (b - a).xyz and (c - a).xyz of every triangle, padded by three
+    std::array<std::vector<float>, 9> streams;
+};
+
+// Diffuse shadowed transfer of every vertex of a mesh onto 3rd order SH,
+// 9 coefficients per vertex. Visibility is ray-traced against the mesh
+// itself; directions are rotated to world space by the mesh's fixed model
+// rotation. Cached on disk like DistanceField.
+class RadianceTransfer
+{
+public:
+    RadianceTransfer(const Mesh &mesh, glm::mat3 modelRot, const std::string &cacheDir);
+
+    const std::vector<float> &getCoefficients() const noexcept;
+
+private:
+    void bake(const Mesh &mesh, glm::mat3 modelRot);
+
+    std::vector<float> coefficients;
 };
 
 class Node
@@ -164,15 +259,17 @@ public:
 
     void bindForRender() const;
     void bindAsTextures() const;
+    void setProjection(glm::mat4 projMat) const;
     void unbind() const;
+    GLuint getDepth() const noexcept;
 
 private:
     GLuint gBuffer{0};
-    GLuint position{0};
+    GLuint depth{0};
     GLuint normal{0};
     GLuint albedo{0};
-    GLuint light{0};
-    GLuint rboDepth;
+    // GBufferParams block of shaders/gbuffer.glsl, binding 0
+    GLuint params{0};
 };
 
 class SkyBox
@@ -189,12 +286,22 @@ public:
     void prepare(glm::mat4 proj) const;
     void bindHDR(int pos) const;
     void bindCubeMap(int pos) const;
+    void bindEnvironment(int pos) const;
+    bool canSampleEnvironment() const noexcept;
+    void sampleEnvironment(std::vector<glm::vec4> &samples, std::default_random_engine &engine) const;
+    const std::array<glm::vec3, 9> &getEnvironmentSH() const noexcept;
+    static glm::mat4 captureView(int face, glm::vec3 eye);
 
 private:
+    void buildDistribution(const float *data, int w, int h);
+    void projectSH(const float *data, int w, int h);
+
     Pipeline skybox;
     Pipeline capture;
+    Pipeline prefilter;
     GLuint hdr;
     GLuint cubeMap;
+    GLuint environment;
     GLuint VAO;
     GLuint VBO;
     GLuint FBO;
@@ -203,8 +310,18 @@ private:
     GLuint renderProjIndex;
     GLuint captureViewIndex;
     GLuint captureProjIndex;
+    GLuint prefilterViewIndex;
+    GLuint prefilterProjIndex;
+    GLuint prefilterApertureIndex;
     int width;
     int height;
+    // luminance of the HDR map weighted by pixel solid angle, as unnormalized
+    // prefix sums: per row (hdrWidth + 1 each) and over the row totals
+    std::vector<float> conditionalCDF;
+    std::vector<float> marginalCDF;
+    int hdrWidth{0};
+    int hdrHeight{0};
+    std::array<glm::vec3, 9> environmentSH{};
 };
 
 class Renderer
@@ -221,6 +338,7 @@ public:
     virtual void setLight(glm::vec3 lightPos, glm::vec3 lightDir) const = 0;
     virtual void setMode(int newMode);
     virtual void setProj(glm::mat4 projMat);
+    virtual void setScene(std::shared_ptr<Node> root);
 
 protected:
     const std::vector<Mesh> &meshes;
@@ -265,12 +383,45 @@ private:
 const int AO_TYPE_SSDO = 0x0;
 const int AO_TYPE_SSAO = 0x4;
 const int AO_TYPE_NONE = 0x8;
+const int AO_TYPE_GTAO = 0xc;
 const int AO_TYPE_MASK = 0xc;
 const int OUTPUT_TYPE_FULL = 0x0;
 const int OUTPUT_TYPE_DIRECT = 0x1;
 const int OUTPUT_TYPE_BOUNCE = 0x2;
 const int OUTPUT_TYPE_AO = 0x3;
 const int OUTPUT_TYPE_MASK = 0x3;
+const int KERNEL_TYPE_RANDOM = 0x00;
+const int KERNEL_TYPE_HALTON = 0x10;
+const int KERNEL_TYPE_SOBOL = 0x20;
+const int KERNEL_TYPE_FIBONACCI = 0x30;
+const int KERNEL_TYPE_MASK = 0x30;
+const int PASS_FUSED = 0x100;
+const int PASS_TILED = 0x200;
+const int PASS_TEMPORAL = 0x400;
+const int PASS_DEINTERLEAVED = 0x800;
+const int PASS_DEPTH_PYRAMID = 0x1000;
+const int PASS_VISIBILITY = 0x2000;
+const int PASS_DEPTH_PREPASS = 0x4000;
+const int PASS_BENT_NORMAL = 0x8000;
+const int PASS_ENV_SAMPLING = 0x10000;
+const int PASS_BLUE_NOISE = 0x20000;
+const int PASS_ADAPTIVE = 0x40000;
+const int PASS_ADAPTIVE_TILES = 0x80000;
+const int PASS_RADIANCE_PYRAMID = 0x100000;
+const int PASS_FEEDBACK = 0x200000;
+const int PASS_RESTIR = 0x400000;
+const int PASS_SDF_AO = 0x800000;
+const int PASS_PRT = 0x1000000;
+const int PASS_HYBRID = 0x2000000;
+const int PASS_VOXEL_GI = 0x4000000;
+const int PASS_PROBES = 0x8000000;
+
+struct SamplingIndex
+{
+    GLint sampleCount;
+    GLint sampleOffset;
+    GLint rotation;
+};
 
 class SSDORenderer : public Renderer
 {
@@ -289,36 +440,107 @@ public:
     SSDORenderer &operator=(BaselineRenderer &&) = delete;
     ~SSDORenderer() override;
     void setLight(glm::vec3 lightPos, glm::vec3 lightDir) const override;
+    void setMode(int newMode) override;
+    void setProj(glm::mat4 projMat) override;
+    void setScene(std::shared_ptr<Node> root) override;
+    void benchmark(std::shared_ptr<Node> root, glm::mat4 proj, const Camera &camera, int iterations) const;
+    void tuneSampleCount(std::shared_ptr<Node> root, glm::mat4 proj, const Camera &camera);
 
 private:
     void makeSSDODirectFBO();
     void makeSSDOIndirectFBO();
+    void makeFusedFBO();
+    void makeHistoryFBO();
+    void makeReservoirs();
+    void makeLayers();
+    void makeDepthPyramid();
+    void makeRadiancePyramid();
+    void makeFeedback();
+    void makeVisibilityFBO();
     void makeBlurFBO();
+    void makeMask();
     void makeShadowFBO();
-    void makeKernel();
+    void makeKernel(int type, unsigned seed = 0);
+    void uploadKernel() const;
     void makeNoise();
+    void makeBlueNoise();
+    void makeEnvironmentSamples();
+    void makeAdaptive();
+    void makeDistanceFields();
+    void makePRTFBO();
+    void makeHybrid();
+    void makeVoxels();
+    void makeWhiteTexture();
+    void makeProbes();
+    void placeProbes(glm::vec3 lo, glm::vec3 hi);
+    void makeProbeGrid();
 
     void render(std::shared_ptr<Node> root, glm::mat4 proj, const Camera &camera) const override;
-    void geometryPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const;
+    void depthPrepass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const;
+    void chooseDepthPrepass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const;
+    bool collectDepthPrepass() const;
+    void geometryPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat, bool prepassed) const;
     void geometryRender(int idx, glm::mat4 modelMat, glm::mat4 viewMat, glm::mat4 projMat) const;
+    bool visibilityPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const;
+    void resolvePass(glm::mat4 viewMat, glm::mat4 projMat) const;
+    void maskPass() const;
+    void depthPyramidPass() const;
+    void radiancePyramidPass(glm::mat4 viewMat) const;
+    void classifyPass() const;
+    void beginAdaptiveStats() const;
+    void endAdaptiveStats() const;
     void ssdoDirectPass(glm::mat4 viewMat, glm::mat4 projMat) const;
     void ssdoIndirectPass(glm::mat4 projMat) const;
-    void blurPass() const;
+    void fusedPass(glm::mat4 viewMat, glm::mat4 projMat) const;
+    void gtaoPass(glm::mat4 projMat) const;
+    void tiledPass(glm::mat4 viewMat, glm::mat4 projMat) const;
+    void deinterleavedPass(glm::mat4 viewMat, glm::mat4 projMat) const;
+    void temporalPass(glm::mat4 viewMat, glm::mat4 projMat) const;
+    void restirPass(glm::mat4 viewMat, glm::mat4 projMat) const;
+    void sdfAOPass(std::shared_ptr<Node> root, glm::mat4 viewMat) const;
+    void prtPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const;
+    void hybridPass(glm::mat4 viewMat, glm::mat4 projMat) const;
+    void setSampling(const Pipeline &pipeline, SamplingIndex index, int count, int offset, float rotation) const;
+    void updateEnvironmentSamples() const;
+    void bindNoise(int pos) const;
+    void blurPass(GLuint sourceBuffer, GLuint targetFBO, int radius) const;
     void shadowPass(std::shared_ptr<Node> root) const;
     void shadowRender(int idx, glm::mat4 modelMat) const;
+    void voxelizePass(std::shared_ptr<Node> root) const;
+    void updateProbes(std::shared_ptr<Node> root) const;
+    void bakeProbe(std::shared_ptr<Node> root, int index) const;
     void lightingPass(glm::vec3 viewPos) const;
-    void stencilPass(std::shared_ptr<Node> root, glm::mat4 viewMat, glm::mat4 projMat) const;
-    void stencilRender(int idx, glm::mat4 modelMat, glm::mat4 viewMat, glm::mat4 projMat) const;
-    void setMode(int newMode) override;
-    void setProj(glm::mat4 projMat) override;
+    void feedbackPass(glm::vec3 viewPos, glm::mat4 viewMat) const;
 
     Pipeline geometry;
+    Pipeline visibility;
+    Pipeline prepass;
+    Pipeline resolve;
     Pipeline ssdoDirect;
     Pipeline ssdoIndirect;
+    Pipeline fused;
+    Pipeline gtao;
+    Pipeline tiled;
+    Pipeline temporal;
+    Pipeline restir;
+    Pipeline restirSpatial;
+    Pipeline sdfAO;
+    Pipeline prt;
+    Pipeline hybrid;
+    Pipeline voxelize;
+    Pipeline voxelResolve;
+    Pipeline probe;
+    Pipeline probeProject;
+    Pipeline deinterleave;
+    Pipeline deinterleaved;
+    Pipeline reinterleave;
+    Pipeline depthPyramid;
+    Pipeline radiancePyramid;
+    Pipeline classify;
+    Pipeline mask;
     Pipeline blur;
     Pipeline shadow;
     Pipeline lighting;
-    Pipeline stencil;
     Quad quad;
     SkyBox skybox;
     GBuffer gBuffer;
@@ -326,11 +548,80 @@ private:
     GLuint directBuffer;
     GLuint indirectFBO;
     GLuint indirectBuffer;
+    GLuint fusedFBO;
+    std::array<GLuint, 2> historyFBO{};
+    std::array<GLuint, 2> historyDirect{};
+    std::array<GLuint, 2> historyIndirect{};
+    std::array<GLuint, 2> historyGeometry{};
+    std::array<GLuint, 2> restirFBO{};
+    std::array<GLuint, 2> restirSpatialFBO{};
+    std::array<GLuint, 2> restirReservoir{};
+    std::array<GLuint, 2> restirGeometry{};
+    GLuint restirTemporalReservoir{0};
+    GLuint layerPosition;
+    GLuint layerNormal;
+    GLuint layerAlbedo;
+    GLuint layerDirect;
+    GLuint layerIndirect;
+    GLuint depthPyramidBuffer{0};
+    int depthPyramidLevels{0};
+    GLuint visibilityFBO;
+    GLuint visibilityBuffer;
+    GLuint maskFBO;
+    GLuint maskBuffer;
+    GLuint radianceBuffer{0};
+    GLuint patchPositionBuffer{0};
+    GLuint patchNormalBuffer{0};
+    GLuint feedbackFBO{0};
+    GLuint feedbackBuffer{0};
+    GLuint feedbackDepth{0};
+    GLuint tileBuffer{0};
+    GLuint adaptiveStatsBuffer{0};
     GLuint blurFBO;
     GLuint blurBuffer;
+    GLuint blurTmpFBO;
+    GLuint blurTmpBuffer;
+    GLuint indirectBlurFBO;
+    GLuint indirectBlurBuffer;
+    GLuint lightBlurFBO;
+    GLuint lightBlurBuffer;
     GLuint shadowFBO;
     GLuint shadowBuffer;
     GLuint noiseTexture;
+    GLuint blueNoiseTexture;
+    GLuint envSamplesUBO;
+    // PASS_SDF_AO: one distance field per mesh, baked on first use and
+    // stacked along z in distanceFieldTexture
+    std::vector<DistanceField> distanceFields;
+    GLuint distanceFieldTexture{0};
+    GLuint distanceFieldUBO{0};
+    GLuint prtFBO;
+    // PASS_HYBRID: world-space BVH of the whole scene, see setScene
+    GLuint sceneNodesBuffer{0};
+    GLuint sceneTrianglesBuffer{0};
+    GLuint hybridStatsBuffer;
+    // PASS_VOXEL_GI: lit surfaces in a mipmapped voxel cube around the scene
+    GLuint voxelFBO{0};
+    GLuint voxelTexture{0};
+    // four uints per voxel, see voxelsums.glsl
+    GLuint voxelSumsBuffer{0};
+    // 1x1 white, the albedo voxelized for meshes without a diffuse map
+    GLuint whiteTexture{0};
+    glm::vec3 voxelGridMin{0.0f};
+    float voxelGridSize{1.0f};
+    // PASS_PROBES: probeCounts probes probeSpacing apart from probeGridMin,
+    // each captured as six faces side by side in probeFBO
+    GLuint probeFBO{0};
+    GLuint probeRadianceBuffer{0};
+    GLuint probeDistanceBuffer{0};
+    GLuint probeDepthBuffer{0};
+    GLuint probeSHBuffer{0};
+    GLuint probeMomentsTexture{0};
+    glm::vec3 probeGridMin{0.0f};
+    float probeSpacing{1.0f};
+    float probeFar{1.0f};
+    glm::ivec3 probeCounts{0};
+    int probeTilesPerRow{1};
     GLint WVPIndex;
     GLint WVIndex;
     GLint lightMatIndex;
@@ -338,17 +629,106 @@ private:
     GLint shadowModelMatIndex;
     GLint shadowLightMatIndex;
     GLint modelMatIndex;
-    GLint viewMatIndex;
+    GLint invViewRotIndex;
     GLint projMatIndex;
     GLint indProjMatIndex;
+    GLint fusedInvViewRotIndex;
+    GLint fusedProjMatIndex;
+    GLint fusedAOTypeIndex;
+    GLint gtaoProjMatIndex;
+    GLint gtaoRotationIndex;
+    GLint tiledInvViewRotIndex;
+    GLint tiledProjMatIndex;
+    GLint tiledAOTypeIndex;
+    GLint temporalInvViewMatIndex;
+    GLint temporalPrevViewMatIndex;
+    GLint temporalProjMatIndex;
+    GLint temporalResetIndex;
+    GLint restirInvViewRotIndex;
+    GLint restirProjMatIndex;
+    GLint restirToPrevViewIndex;
+    GLint restirFrameIndex;
+    GLint restirResetIndex;
+    GLint restirSpatialInvViewRotIndex;
+    GLint restirSpatialProjMatIndex;
+    GLint restirSpatialFrameIndex;
+    GLint sdfAOInvViewRotIndex;
+    GLint sdfAOTypeIndex;
+    GLint sdfAOInstanceCountIndex;
+    GLint sdfAOStartOffsetIndex;
+    GLint sdfAOTraceDistanceIndex;
+    GLint prtWVPIndex;
+    GLint prtAOTypeIndex;
+    GLint hybridInvViewMatIndex;
+    GLint hybridInvViewRotIndex;
+    GLint hybridProjMatIndex;
+    GLint hybridAOTypeIndex;
+    GLint hybridCollectStatsIndex;
+    GLint voxelizeModelMatIndex;
+    GLint voxelizeLightMatIndex;
+    GLint voxelizeLightPosIndex;
+    GLint voxelizeLightDirIndex;
+    GLint voxelizeGridMinIndex;
+    GLint voxelizeGridSizeIndex;
+    GLint indirectVoxelConeIndex;
+    GLint indirectViewToVoxelIndex;
+    GLint probeModelMatIndex;
+    GLint probeViewProjIndex;
+    GLint probePosIndex;
+    GLint probeLightMatIndex;
+    GLint probeLightPosIndex;
+    GLint probeLightDirIndex;
+    GLint probeProjectProbeIndex;
+    GLint indirectProbeGridIndex;
+    GLint indirectInvViewMatIndex;
+    GLint deinterleavedInvViewRotIndex;
+    GLint deinterleavedProjMatIndex;
+    GLint deinterleavedAOTypeIndex;
+    GLint depthPyramidLevelIndex;
+    GLint radiancePyramidLevelIndex;
+    GLint radiancePyramidViewMatIndex;
+    GLint radiancePyramidLightPosIndex;
+    GLint indirectRadiancePyramidIndex;
+    GLint indirectFeedbackIndex;
+    GLint indirectToPrevViewIndex;
+    GLint visibilityWVPIndex;
+    GLint visibilityDrawIDIndex;
+    GLint prepassWVPIndex;
+    GLint resolveDrawIDIndex;
+    GLint resolveModelMatIndex;
+    GLint resolveWVPIndex;
+    GLint resolveLightMatIndex;
+    GLint resolveLightDirIndex;
+    GLint resolveShininessIndex;
+    GLint directDepthPyramidIndex;
+    GLint indirectDepthPyramidIndex;
+    GLint fusedDepthPyramidIndex;
+    GLint directBentNormalIndex;
+    GLint fusedBentNormalIndex;
+    GLint directEnvSamplingIndex;
+    GLint directAdaptiveIndex;
+    GLint indirectAdaptiveIndex;
+    GLint directAdaptiveTilesIndex;
+    GLint indirectAdaptiveTilesIndex;
+    GLint directCollectStatsIndex;
+    GLint indirectCollectStatsIndex;
+    SamplingIndex directSampling;
+    SamplingIndex indirectSampling;
+    SamplingIndex fusedSampling;
+    SamplingIndex tiledSampling;
+    SamplingIndex deinterleavedSampling;
+    SamplingIndex hybridSampling;
     GLint lightPosIndex;
     GLint viewPosIndex;
     GLint shininessIndex;
     GLint shininessStrengthIndex;
-    GLint stencilWVPIndex;
+    GLint blurDirectionIndex;
+    GLint blurRadiusIndex;
+    GLint blurShadowMaskIndex;
     GLint AOTypeIndex;
     GLint lightingAOTypeIndex;
     GLint outputTypeIndex;
+    int outputType{OUTPUT_TYPE_FULL};
     bool _diffuseMap{false};
     bool _specularMap{false};
     bool _normalsMap{false};
@@ -356,7 +736,51 @@ private:
     int _width;
     int _height;
 
+    mutable int frameIndex{0};
+    mutable int historyIndex{0};
+    mutable bool historyValid{false};
+    mutable glm::mat4 prevViewMat;
+    // mesh and model matrix of every draw of the last visibility pass, by draw ID
+    mutable std::vector<std::pair<int, glm::mat4>> visibilityDraws;
+    // PASS_DEPTH_PREPASS re-times both geometry variants every prepassProbeInterval frames
+    mutable int prepassFrame{0};
+    mutable bool usePrepass{false};
+    // timer queries of the plain and pre-passed variants, read once available
+    std::array<GLuint, 2> prepassQueries;
+    mutable bool prepassPending{false};
+    mutable std::default_random_engine envEngine;
+    mutable std::vector<glm::vec4> envSamples;
+    // PASS_ADAPTIVE prints the average samples per pixel every adaptiveStatsInterval frames
+    mutable int adaptiveFrame{0};
+    // last setLight position, direction and shadow matrix, for passes whose
+    // programs are created lazily
+    mutable glm::vec3 lightPosition{0.0f};
+    mutable glm::vec3 lightDirection{0.0f};
+    mutable glm::mat4 lightMatrix{1.0f};
+    // PASS_FEEDBACK: the last frame's fully lit image, its depth and view
+    mutable bool feedbackValid{false};
+    mutable glm::mat4 feedbackViewMat;
+    // PASS_RESTIR reservoirs ping-pong like the temporal history
+    mutable int restirIndex{0};
+    mutable int restirFrame{0};
+    mutable bool restirValid{false};
+    mutable glm::mat4 restirViewMat;
+    // PASS_HYBRID prints the fraction of traced samples every hybridStatsInterval frames
+    mutable int hybridFrame{0};
+    // signalled when the counted dispatch has finished, then they are read
+    mutable GLsync hybridStatsFence{nullptr};
+    // the voxels are rebuilt only after the light or the scene changed
+    mutable bool voxelsValid{false};
+    // probes of the current full bake done so far, probeBakeCount more per frame
+    mutable int probesBaked{0};
+    mutable int probeBakeCount{1};
+    // times the bakes of one frame, probeQueryBaked of them
+    GLuint probeQuery{0};
+    mutable bool probeQueryPending{false};
+    mutable int probeQueryBaked{0};
+
     std::array<GLfloat, 64 * 3> kernel;
+    int kernelType{KERNEL_TYPE_RANDOM};
 };
 
 class Scene
@@ -371,20 +795,50 @@ public:
 
     void render(glm::mat4 proj, const Camera &camera) const;
     void setMode(int newMode);
+    void benchmark(const Camera &camera) const;
+    void tuneSampleCount(const Camera &camera) const;
 
     std::map<std::string, Texture> loadMaterialTexures(unsigned int index);
     MaterialParams loadMaterialParams(unsigned int index);
 
 private:
+    void bakeTransfer();
+
     const aiScene *ai_scene;
     std::string dir;
     std::shared_ptr<Node> root;
     std::map<std::string, Texture> loadedTextures;
     std::vector<Mesh> meshes;
+    bool transferBaked{false};
 
     std::unique_ptr<Renderer> renderer;
 };
 
+// GL_TIME_ELAPSED query over a number of runs of a pass. The result is only
+// read when it is printed, so a benchmark queues all of its timings before
+// the CPU waits on the first one.
+class GPUTimer
+{
+public:
+    GPUTimer(GLuint query, int iterations);
+    GPUTimer(const GPUTimer &) = delete;
+    GPUTimer &operator=(const GPUTimer &) = delete;
+    GPUTimer(GPUTimer &&);
+    GPUTimer &operator=(GPUTimer &&) = delete;
+    ~GPUTimer() noexcept;
+
+    double milliseconds() const;
+
+private:
+    GLuint _query{0};
+    int _iterations{1};
+};
+std::ostream &operator<<(std::ostream &os, const GPUTimer &timer);
+
 GLuint TextureFromFile(const std::string &path, const std::string &directory, bool gamma);
+GLuint makeTargetTexture(GLint internalFormat, int width, int height);
+GLuint makeLayeredTexture(GLint internalFormat, int width, int height, int layers);
+GPUTimer timeGPU(std::function<void()> func, int iterations);
+void makeRenderTarget(GLuint &FBO, GLuint &buffer, GLint internalFormat, int width, int height);
 
 #endif
\ No newline at end of file
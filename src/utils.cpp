@@ -59,3 +59,29 @@ std::string loadFile(const std::string &fileName)
     ss << fin.rdbuf();
     return ss.str();
 }
+std::string loadFileWithIncludes(const std::string &fileName)
+{
+    const std::string directive{"#include"};
+    auto slash = fileName.find_last_of("/\\");
+    std::string dir = slash == std::string::npos ? "" : fileName.substr(0, slash + 1);
+
+    std::istringstream fin(loadFile(fileName));
+    std::stringstream ss;
+    std::string line;
+    while (std::getline(fin, line))
+    {
+        auto pos = line.find_first_not_of(" \t");
+        if (pos != std::string::npos && line.compare(pos, directive.size(), directive) == 0)
+        {
+            auto begin = line.find('"', pos + directive.size());
+            auto end = line.find('"', begin + 1);
+            if (begin != std::string::npos && end != std::string::npos)
+            {
+                ss << loadFileWithIncludes(dir + line.substr(begin + 1, end - begin - 1)) << '\n';
+                continue;
+            }
+        }
+        ss << line << '\n';
+    }
+    return ss.str();
+}
@@ -50,5 +50,7 @@ private:
 
 // File
 std::string loadFile(const std::string &fileName);
+// Expands #include "file" lines, paths relative to the including file
+std::string loadFileWithIncludes(const std::string &fileName);
 
 #endif
\ No newline at end of file